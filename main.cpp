@@ -1,14 +1,185 @@
+#include <bit>
 #include <cmath>
+#include <span>
+#include <mutex>
+#include <array>
+#include <cstdio>
+#include <string>
+#include <cstring>
+#include <sstream>
+#include <chrono>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <memory>
 #include <numeric>
+#include <utility>
 #include <optional>
+#include <random>
+#include <algorithm>
+#include <string_view>
+#include <filesystem>
+#include <condition_variable>
 
 #define OLC_PGE_APPLICATION
 #include "olcPixelGameEngine.h"
 
+// Define VF3D_SIMD to store vf3d in SIMD registers: SSE on x86/x64, or NEON on ARM.
+#if defined(VF3D_SIMD)
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VF3D_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VF3D_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+// Writing binary data to stdout needs it switched out of text mode on Windows.
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+// Define EXR_ZIP (and link with zlib) to allow writing zip compressed EXR files.
+#if defined(EXR_ZIP)
+#include <zlib.h>
+#endif
+
 /***** TYPES *****/
 
+#if defined(VF3D_SSE) || defined(VF3D_NEON)
+
+// A handful of 4-lane primitives that the SIMD vf3d is built from.
+#if defined(VF3D_SSE)
+using lanes = __m128;
+inline lanes lanes_set(float f) { return _mm_set1_ps(f); }
+inline lanes lanes_add(lanes a, lanes b) { return _mm_add_ps(a, b); }
+inline lanes lanes_sub(lanes a, lanes b) { return _mm_sub_ps(a, b); }
+inline lanes lanes_mul(lanes a, lanes b) { return _mm_mul_ps(a, b); }
+inline lanes lanes_div(lanes a, lanes b) { return _mm_div_ps(a, b); }
+
+// Sum the x, y and z lanes into every lane (ignoring w).
+inline lanes lanes_sum3(lanes v) {
+	lanes y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+	lanes z = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+	lanes sum = _mm_add_ss(_mm_add_ss(v, y), z);
+	return _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0));
+}
+
+// Approximate 1/sqrt(v), refined with one Newton-Raphson step: r' = r * (1.5 - 0.5 * v * r * r).
+inline lanes lanes_rsqrt(lanes v) {
+	lanes r = _mm_rsqrt_ps(v);
+	lanes half_v_r2 = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), v), _mm_mul_ps(r, r));
+	return _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), half_v_r2));
+}
+
+inline float lanes_first(lanes v) { return _mm_cvtss_f32(v); }
+inline float lanes_sqrt_first(lanes v) { return _mm_cvtss_f32(_mm_sqrt_ss(v)); }
+#else
+using lanes = float32x4_t;
+inline lanes lanes_set(float f) { return vdupq_n_f32(f); }
+inline lanes lanes_add(lanes a, lanes b) { return vaddq_f32(a, b); }
+inline lanes lanes_sub(lanes a, lanes b) { return vsubq_f32(a, b); }
+inline lanes lanes_mul(lanes a, lanes b) { return vmulq_f32(a, b); }
+#if defined(__aarch64__) || defined(_M_ARM64)
+inline lanes lanes_div(lanes a, lanes b) { return vdivq_f32(a, b); }
+#else
+// ARMv7 NEON has no divide: refine the reciprocal estimate twice and multiply.
+inline lanes lanes_div(lanes a, lanes b) {
+	lanes r = vrecpeq_f32(b);
+	r = vmulq_f32(r, vrecpsq_f32(b, r));
+	r = vmulq_f32(r, vrecpsq_f32(b, r));
+	return vmulq_f32(a, r);
+}
+#endif
+
+// Sum the x, y and z lanes into every lane (ignoring w).
+inline lanes lanes_sum3(lanes v) {
+	return vdupq_n_f32(vgetq_lane_f32(v, 0) + vgetq_lane_f32(v, 1) + vgetq_lane_f32(v, 2));
+}
+
+// Approximate 1/sqrt(v), refined with one Newton-Raphson step (vrsqrtsq computes (3 - a * b) / 2).
+inline lanes lanes_rsqrt(lanes v) {
+	lanes r = vrsqrteq_f32(v);
+	return vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(v, r), r));
+}
+
+inline float lanes_first(lanes v) { return vgetq_lane_f32(v, 0); }
+inline float lanes_sqrt_first(lanes v) { return sqrtf(vgetq_lane_f32(v, 0)); }
+#endif
+
+// Struct to describe a 3D floating point vector, padded to four lanes and
+// overlaid on a SIMD register (much like olc::Pixel overlays r, g, b and a).
+struct vf3d {
+	union {
+		lanes v;
+		// The fourth lane is padding (always zero when constructed from values).
+		struct { float x, y, z, w; };
+	};
+
+	/* CONSTRUCTORS */
+
+	// Default constructor.
+	vf3d() = default;
+
+	// Explicit constructor that initializes x, y, and z.
+	constexpr vf3d(float x, float y, float z) : x(x), y(y), z(z), w(0) {}
+
+	// Explicit constructor that initializes x, y, and z to the same value.
+	constexpr vf3d(float f) : x(f), y(f), z(f), w(0) {}
+
+	// Explicit constructor that wraps a SIMD register.
+	vf3d(lanes v) : v(v) {}
+
+	/* OPERATORS */
+
+	// Addition: vf3d + vf3d = vf3d
+	const vf3d operator+(const vf3d right) const {
+		return vf3d(lanes_add(v, right.v));
+	}
+
+	// Subtraction: vf3d - vf3d = vf3d
+	const vf3d operator-(const vf3d right) const {
+		return vf3d(lanes_sub(v, right.v));
+	}
+
+	// Division: vf3d / float = vf3d
+	const vf3d operator/(float divisor) const {
+		return vf3d(lanes_div(v, lanes_set(divisor)));
+	}
+
+	// Multiplication: vf3d * float = vf3d
+	const vf3d operator*(float factor) const {
+		return vf3d(lanes_mul(v, lanes_set(factor)));
+	}
+
+	// Dot product (multiplication): vf3d * vf3d = float
+	const float operator* (const vf3d right) const {
+		return lanes_first(lanes_sum3(lanes_mul(v, right.v)));
+	}
+
+	/* METHODS */
+
+	// Return a normalized version of this vf3d (magnitude == 1), using a fast
+	// reciprocal square root rather than a square root and a divide.
+	const vf3d normalize() const {
+		return vf3d(lanes_mul(v, lanes_rsqrt(lanes_sum3(lanes_mul(v, v)))));
+	}
+
+	// Return the length of this vf3d.
+	const float length() const {
+		return lanes_sqrt_first(lanes_sum3(lanes_mul(v, v)));
+	}
+
+	// Return the cross product of this vf3d and another (perpendicular to both).
+	const vf3d cross(const vf3d right) const {
+		return { y * right.z - z * right.y, z * right.x - x * right.z, x * right.y - y * right.x };
+	}
+};
+
+#else
+
 // Struct to describe a 3D floating point vector.
 struct vf3d {
 	float x, y, z;
@@ -62,8 +233,15 @@ struct vf3d {
 	const float length() const {
 		return sqrtf(x * x + y * y + z * z);
 	}
+
+	// Return the cross product of this vf3d and another (perpendicular to both).
+	const vf3d cross(const vf3d right) const {
+		return { y * right.z - z * right.y, z * right.x - x * right.z, x * right.y - y * right.x };
+	}
 };
 
+#endif
+
 // Use a type alias to use vf3d and color3 interchangeably.
 using color3 = vf3d;
 
@@ -99,12 +277,60 @@ struct ray {
 	}
 };
 
+// Struct to describe an axis-aligned bounding box.
+struct aabb {
+	vf3d min, max;
+
+	/* CONSTRUCTORS */
+
+	// Default constructor.
+	aabb() = default;
+
+	// Explicit constructor that initializes min and max.
+	constexpr aabb(const vf3d min, const vf3d max) : min(min), max(max) {}
+
+	/* METHODS */
+
+	// Return the smallest aabb containing both this aabb and another.
+	const aabb merge(const aabb other) const {
+		return {
+			{ std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z) },
+			{ std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z) }
+		};
+	}
+
+	// Determine the range of distances along a given ray that lie inside this aabb (if any).
+	std::optional<std::pair<float, float>> intersection(const ray& r) const {
+		// Intersect the ray with each pair of axis-aligned "slabs", keeping the overlap.
+		float t_enter = -INFINITY, t_exit = INFINITY;
+		const float origin[3] = { r.origin.x, r.origin.y, r.origin.z };
+		const float direction[3] = { r.direction.x, r.direction.y, r.direction.z };
+		const float lower[3] = { min.x, min.y, min.z };
+		const float upper[3] = { max.x, max.y, max.z };
+		for (int axis = 0; axis < 3; axis++) {
+			float inverse = 1.0f / direction[axis];
+			float t0 = (lower[axis] - origin[axis]) * inverse;
+			float t1 = (upper[axis] - origin[axis]) * inverse;
+			if (t0 > t1) std::swap(t0, t1);
+			t_enter = std::max(t_enter, t0);
+			t_exit = std::min(t_exit, t1);
+		}
+
+		if (t_enter > t_exit || t_exit < 0)
+			return {};
+
+		return std::make_pair(t_enter, t_exit);
+	}
+};
+
 // Class to describe any kind of object we want to add to our scene.
 class Shape {
 public:
 	vf3d origin;
 	color3 fill;
 	float reflectivity;
+	// How far this Shape moved during the last update.
+	vf3d motion = vf3d(0);
 
 	/* CONSTRUCTORS */
 
@@ -120,10 +346,21 @@ public:
 	virtual color3 sample(ray sample_ray) const { return fill; }
 
 	// Determin how far along a given ray this Shape intersects (if at all).
-	virtual std::optional<float> intersection(ray r) const = 0;
+	virtual std::optional<float> intersection(const ray& r) const = 0;
 
 	// Determine the surface normal of this Shape at a given intersection point.
 	virtual ray normal(vf3d incident) const = 0;
+
+	// Mark which of a packet of (normalized) rays from the same origin this Shape
+	// blocks before their max_distances. Already occluded rays are skipped.
+	virtual void occlusion(vf3d ray_origin, std::span<const vf3d> directions, std::span<const float> max_distances, std::span<bool> occluded) const {
+		for (size_t i = 0; i < directions.size(); i++)
+			if (!occluded[i])
+				occluded[i] = intersection(ray(ray_origin, directions[i])).value_or(INFINITY) < max_distances[i];
+	}
+
+	// Get the bounding box of this Shape (or nothing, if it extends infinitely).
+	virtual std::optional<aabb> bounds() const { return {}; }
 };
 
 // Subclass of Shape that represents a Sphere.
@@ -142,7 +379,7 @@ public:
 	/* METHODS */
 
 	// Determine how far along a given ray this Circle intersects (if at all).
-	std::optional<float> intersection(ray r) const override {
+	std::optional<float> intersection(const ray& r) const override {
 		vf3d oc = r.origin - origin;
 
 		float a = r.direction * r.direction;
@@ -164,6 +401,29 @@ public:
 	ray normal(vf3d incident) const override {
 		return { incident, (incident - origin).normalize() };
 	}
+
+	// Since every ray in the packet starts at the same point, everything in our
+	// intersection test that doesn't depend on direction only needs working out once.
+	void occlusion(vf3d ray_origin, std::span<const vf3d> directions, std::span<const float> max_distances, std::span<bool> occluded) const override {
+		vf3d oc = ray_origin - origin;
+		float c = (oc * oc) - (radius * radius);
+
+		for (size_t i = 0; i < directions.size(); i++) {
+			// With a normalized direction, a == 1.
+			float b = 2.0f * (oc * directions[i]);
+			float discriminant = b * b - 4 * c;
+			if (occluded[i] || discriminant < 0)
+				continue;
+
+			float distance = (-b - sqrtf(discriminant)) / 2.0f;
+			occluded[i] = distance >= 0 && distance < max_distances[i];
+		}
+	}
+
+	// Return the bounding box of this Sphere.
+	std::optional<aabb> bounds() const override {
+		return aabb(origin - radius, origin + radius);
+	}
 };
 
 // Subclass of Shape that represents a flat Plane.
@@ -183,7 +443,7 @@ public:
 	/* METHODS */
 
 	// Determine how far along a given ray this Plane intersects (if at all).
-	std::optional<float> intersection(ray sample_ray) const override {
+	std::optional<float> intersection(const ray& sample_ray) const override {
 		auto denom = direction * sample_ray.direction;
 		if (fabs(denom) > 0.001f) {
 			auto ret = (origin - sample_ray.origin) * direction / denom;
@@ -222,253 +482,2902 @@ public:
 	}
 };
 
-/***** CONSTANTS *****/
+// A light, which lights up everything within its radius. It's either a point,
+// or an "area light" with a surface that casts soft shadows.
+struct Light {
+	// The shapes a Light can be.
+	enum class Type {
+		// An infinitely small point.
+		Point,
+		// A sphere, `size` in radius.
+		Sphere,
+		// A rectangle, centered on origin, with sides edge_u and edge_v.
+		Rectangle,
+	};
 
-// Game width and height (in pixels).
-constexpr int WIDTH = 250;
-constexpr int HEIGHT = 250;
+	vf3d origin;
+	color3 color;
+	float intensity;
+	// How far this light reaches (INFINITY to reach everything).
+	float radius;
 
-// Half the game width and height (to identify the center of the screen).
-constexpr float HALF_WIDTH = WIDTH / 2.0f;
-constexpr float HALF_HEIGHT = HEIGHT / 2.0f;
+	// The shape of this Light, and how big it is.
+	Type type = Type::Point;
+	float size = 0;
+	vf3d edge_u = vf3d(0), edge_v = vf3d(0);
 
-// Colors
+	/* CONSTRUCTORS */
 
-color3 LIGHT_GRAY(0.8f);
-color3 DARK_GRAY(0.5f);
-color3 GREY(0.75f);
-color3 RED(1.0f, 0.0f, 0.0f);
-color3 GREEN(0.0f, 1.0f, 0.0f);
+	// Delete the default constructor (every Light needs a position).
+	Light() = delete;
 
-// Fog distance and reciprocal (falloff).
-constexpr float FOG_INTENSITY_INVERSE = 3000;
-constexpr float FOG_INTENSITY = 1 / FOG_INTENSITY_INVERSE;
+	// Add explicit constructor that initializes origin, color, intensity and radius.
+	Light(vf3d origin, color3 color = color3(1.0f), float intensity = 1.0f, float radius = INFINITY)
+		: origin(origin), color(color), intensity(intensity), radius(radius) {}
 
-// A color representing scene fog.
-color3 FOG = DARK_GRAY;
+	/* METHODS */
 
-// Lighting
-constexpr float AMBIENT_LIGHT = 0.5f;
+	// How much of this light reaches a given distance: all of it up close,
+	// fading smoothly to nothing at its radius.
+	float falloff(float distance) const {
+		float ratio = distance / radius;
+		float window = std::max(1 - ratio * ratio, 0.0f);
+		return window * window;
+	}
 
-#ifdef DEBUG
-constexpr int BOUNCES = 2;
-constexpr int SAMPLES = 2;
-#else
-constexpr int BOUNCES = 5;
-constexpr int SAMPLES = 4;
-#endif
+	// Pick points on this Light, as seen from a point in the scene, for pairs of
+	// numbers (u, v) in [0, 1). Spread-out pairs give spread-out points.
+	void SamplePoints(vf3d from, std::span<const olc::vf2d> uvs, std::span<vf3d> points) const {
+		switch (type) {
+		case Type::Sphere: {
+			// A sphere looks like a disc from any point, so pick points on the disc
+			// facing it. First find two directions across that disc...
+			vf3d axis = (from - origin).normalize();
+			vf3d across = axis.cross(fabs(axis.x) > 0.9f ? vf3d(0, 1, 0) : vf3d(1, 0, 0)).normalize();
+			vf3d up = axis.cross(across);
+
+			// ...then turn each (u, v) into a distance from the center and an angle around it.
+			for (size_t i = 0; i < uvs.size(); i++) {
+				float distance = size * sqrtf(uvs[i].x), angle = 2 * 3.14159265f * uvs[i].y;
+				points[i] = origin + across * (distance * cosf(angle)) + up * (distance * sinf(angle));
+			}
+			break;
+		}
+		case Type::Rectangle:
+			for (size_t i = 0; i < uvs.size(); i++)
+				points[i] = origin + edge_u * (uvs[i].x - 0.5f) + edge_v * (uvs[i].y - 0.5f);
+			break;
+		default:
+			std::fill(points.begin(), points.end(), origin);
+		}
+	}
 
-/***** PIXEL GAME ENGINE CLASS *****/
+	// How far the surface of this Light extends from its origin.
+	float extent() const {
+		switch (type) {
+		case Type::Sphere: return size;
+		case Type::Rectangle: return (edge_u.length() + edge_v.length()) / 2;
+		default: return 0;
+		}
+	}
 
-// Override base class with your custom functionality
-class OlcPixelRayTracer : public olc::PixelGameEngine {
-public:
-	OlcPixelRayTracer() : light_point(0, -500, -500) {
-		// Name your application
-		sAppName = "RayTracer";
+	// Get the bounding box of everything this Light reaches (or nothing, if it
+	// reaches everything).
+	std::optional<aabb> bounds() const {
+		if (radius == INFINITY) return {};
+		return aabb(origin - radius, origin + radius);
 	}
+};
 
-public:
-	bool OnUserCreate() override {
-		// Called once at the start, so create things here
+/***** THREADING *****/
 
-		// Create a new Sphere and add it to our scene.
-		shapes.emplace_back(std::make_unique<Sphere>(vf3d(0, 0, 200), GREY, 100, 0.9f));
+// A fixed set of worker threads that we can split loops across. The thread
+// calling ParallelFor also helps out, and blocks until every index is done.
+class WorkerPool {
+public:
+	/* CONSTRUCTORS */
 
-		// Add some additional Spheres at different positions.
-		shapes.emplace_back(std::make_unique<Sphere>(vf3d(-150, +75, +300), RED, 100, 0.5f));
-		shapes.emplace_back(std::make_unique<Sphere>(vf3d(+150, -75, +100), GREEN, 100));
+	// Start one worker per hardware thread (less one for the calling thread).
+	WorkerPool(unsigned thread_count = std::thread::hardware_concurrency()) {
+		for (unsigned i = 1; i < std::max(thread_count, 1u); i++)
+			threads.emplace_back([this] { WorkerLoop(); });
+	}
 
-		// Add a "floor" Plane
-		shapes.emplace_back(std::make_unique<Plane>(vf3d(0, 200, 0 ), vf3d(0, -1, 0), LIGHT_GRAY, DARK_GRAY));
+	// Don't copy a pool of running threads.
+	WorkerPool(const WorkerPool&) = delete;
 
-		return true;
+	// Stop and join all of the workers.
+	~WorkerPool() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& thread : threads)
+			thread.join();
 	}
 
-	bool OnUserUpdate(float fElapsedTime) override {
-		// Called once per frame
+	/* METHODS */
 
-		// Create some static storage to accumulate elapsed time...
-		static float accumulated_time = 0.0f;
+	// The number of threads (including the caller) that share the work.
+	unsigned size() const { return unsigned(threads.size()) + 1; }
+
+	// Call fn(i) for every i in [0, count), spread across all threads.
+	template <typename F>
+	void ParallelFor(int count, const F& fn) {
+		if (count <= 0) return;
+
+		// Only one loop can be in flight at a time.
+		std::lock_guard submit_lock(submit);
+		{
+			std::lock_guard lock(mutex);
+			job_context = &fn;
+			job_invoke = [](const void* context, int begin, int end) {
+				for (int i = begin; i < end; i++)
+					(*static_cast<const F*>(context))(i);
+			};
+			job_count = count;
+			// Hand indices out in chunks so workers aren't fighting over the counter.
+			job_grain = std::max(1, count / int(size() * 8));
+			next_index = 0;
+			busy_workers = unsigned(threads.size());
+			generation++;
+		}
+		wake.notify_all();
 
-		// ...and accumulate elapsed time into it.
-		accumulated_time += fElapsedTime;
+		// Do our share of the work, then wait for the workers to finish theirs.
+		RunJob();
+		std::unique_lock lock(mutex);
+		done.wait(lock, [this] { return busy_workers == 0; });
+	}
 
-		// Update the position of our first Circle every update.
-		// sin/cos = easy, cheap motion.
-		Shape& shape = *shapes.at(0);
-		shape.origin.y = sinf(accumulated_time) * 100 - 100;
-		shape.origin.z = cosf(accumulated_time) * 100 + 100;
+private:
+	std::vector<std::thread> threads;
+	std::mutex submit, mutex;
+	std::condition_variable wake, done;
+	bool stopping = false;
+	uint64_t generation = 0;
+	unsigned busy_workers = 0;
+
+	// The loop currently being run.
+	const void* job_context = nullptr;
+	void (*job_invoke)(const void*, int, int) = nullptr;
+	int job_count = 0, job_grain = 1;
+	std::atomic<int> next_index = 0;
+
+	// Claim chunks of the current loop until there are none left.
+	void RunJob() {
+		for (int begin; (begin = next_index.fetch_add(job_grain)) < job_count;)
+			job_invoke(job_context, begin, std::min(begin + job_grain, job_count));
+	}
 
-		// Update the position of our light_point relative to the mouse position.
-		light_point.x = ((GetMouseX() / (float)WIDTH) - 0.5f) * 1000;
-		light_point.y = ((GetMouseY() / (float)HEIGHT) - 0.5f) * 1000 - 700;
+	// Each worker sleeps until a new loop is submitted, then helps run it.
+	void WorkerLoop() {
+		uint64_t seen = 0;
+		while (true) {
+			{
+				std::unique_lock lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+			}
 
-		// Iterate over the rows and columns of the scene
-		for (int y = 0; y < HEIGHT; y++) {
-			for (int x = 0; x < WIDTH; x++) {
-				// Create an array of colors - we'll be sampling this pixel multiple
-				// times with varying offsets to create a multisample, and then
-				// rendering the average of these samples.
-				std::array<color3, SAMPLES> samples;
+			RunJob();
 
-				// For each sample...
-				for (auto i = 0; i < SAMPLES; i++) {
-					// Create random offset within this pixel
-					float offsetX = rand() / (float)RAND_MAX;
-					float offsetY = rand() / (float)RAND_MAX;
+			std::lock_guard lock(mutex);
+			if (--busy_workers == 0)
+				done.notify_one();
+		}
+	}
+};
 
-					// Sample the color at that offset (converting screen coordinates to
-					// scene coordinates).
-					samples[i] = Sample(x - HALF_WIDTH + offsetX, y - HALF_HEIGHT + offsetY);
-				}
+// Passes finished frames from a thread that renders them to a thread that
+// presents them. The renderer writes into a back buffer while the presenter
+// holds the front buffer, and the newest finished frame waits in between. With
+// three buffers the renderer never waits; with two it waits for the presenter
+// to take the waiting frame. The presenter never waits.
+template <typename Frame>
+class FramePipeline {
+public:
+	/* CONSTRUCTORS */
 
-				// Calculate the average color and draw it.
-				color3 color = std::accumulate(samples.begin(), samples.end(), color3()) / SAMPLES;
-				Draw(x, y, olc::PixelF(color.x, color.y, color.z));
-			}
-		}
+	// Create buffer_count (2 or 3) copies of an initial frame to render into.
+	FramePipeline(int buffer_count, const Frame& initial) : buffers(std::clamp(buffer_count, 2, 3), initial) {}
 
-		return true;
+	// Don't copy buffers another thread might be using.
+	FramePipeline(const FramePipeline&) = delete;
+
+	/* METHODS */
+
+	// Renderer: get a buffer that nobody else is using, or nullptr once stopped.
+	Frame* BeginFrame() {
+		std::unique_lock lock(mutex);
+		int free_index = -1;
+		released.wait(lock, [&] {
+			for (int i = 0; i < int(buffers.size()) && free_index < 0; i++)
+				if (i != front && i != ready)
+					free_index = i;
+			return stopping || free_index >= 0;
+		});
+		if (stopping) return nullptr;
+		return &buffers[free_index];
 	}
 
-	color3 Sample(float x, float y) const {
-		// Called to get the color of a specific point on the screen.
+	// Renderer: publish a finished frame, replacing any frame still waiting.
+	void EndFrame(Frame* frame) {
+		std::lock_guard lock(mutex);
+		ready = int(frame - buffers.data());
+	}
 
-		// Create a ray casting into the scene from this "pixel".
-		ray sample_ray({ 0, 0, -800 }, { (x / (float)WIDTH) * 100, (y / (float)HEIGHT) * 100, 200 });
+	// Presenter: take the newest finished frame (if there is one), releasing
+	// the previous one. The frame stays valid until the next call.
+	const Frame* TakeLatest() {
+		{
+			std::lock_guard lock(mutex);
+			if (ready < 0) return nullptr;
+			front = std::exchange(ready, -1);
+		}
+		released.notify_one();
+		return &buffers[front];
+	}
 
-		// Sample this ray - if the ray doesn't hit anything, use the color of
-		// the surrounding fog.
-		return SampleRay(sample_ray.normalize(), BOUNCES).value_or(FOG);
+	// Wake the renderer so it can exit.
+	void Stop() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		released.notify_all();
 	}
 
-	std::optional<color3> SampleRay(ray r, int bounces) const {
-		bounces--;
+private:
+	std::vector<Frame> buffers;
+	std::mutex mutex;
+	std::condition_variable released;
+	bool stopping = false;
 
-		// Called to get the color produced by a specific ray.
+	// The buffer being presented and the finished frame waiting to be (-1 for none).
+	int front = -1, ready = -1;
+};
 
-		// This will be the color we (eventually) return/
-		color3 final_color;
+/***** ACCELERATION STRUCTURES *****/
 
-		// Store a pointer to the Shape this ray intersects with.
-		auto intersected_shape_iterator = shapes.end();
+// A uniform grid of cells over a set of bounding boxes. Building it is O(n)
+// and runs on a WorkerPool, so it's cheap enough to rebuild every frame even
+// when everything in it moves. Rays walk through it cell-by-cell (3D-DDA).
+class UniformGrid {
+public:
+	// Roughly how many cells to create per item, and a cap on cells per axis.
+	static constexpr float CELLS_PER_ITEM = 2.0f;
+	static constexpr int MAX_RESOLUTION = 128;
 
-		// Also store the distance along the ray that the intersection occurs.
-		float intersection_distance = INFINITY;
+	/* METHODS */
 
-		/* Determine the Shape this ray intersects with(if any). */ {
-			// Iterate over all of the Shapes in our scene.
-			for (auto it = shapes.begin(); it != shapes.end(); it++) {
-				// If the distance is not undefined (meaning no intersection)...
-				if (std::optional<float> distance = (*it)->intersection(r).value_or(INFINITY);
-						distance < intersection_distance) {
-					// Save the current Shape as the intersected Shape!
-					intersected_shape_iterator = it;
-					// Also save the distance along the ray that this intersection occurred.
-					intersection_distance = distance.value();
-				}
-			}
+	// Rebuild the grid so that item i occupies boxes[i].
+	void Build(const std::vector<aabb>& boxes, WorkerPool& pool) {
+		items.clear();
+		cell_starts.assign(1, 0);
+		if (boxes.empty()) return;
+		const int count = int(boxes.size());
+
+		// 1) Find the bounds of everything (a parallel reduction over chunks).
+		const int chunks = std::min(count, int(pool.size()) * 4);
+		std::vector<aabb> partial(chunks);
+		pool.ParallelFor(chunks, [&](int chunk) {
+			int begin = chunk * count / chunks, end = (chunk + 1) * count / chunks;
+			partial[chunk] = boxes[begin];
+			for (int i = begin + 1; i < end; i++)
+				partial[chunk] = partial[chunk].merge(boxes[i]);
+		});
+		bounds = std::accumulate(partial.begin() + 1, partial.end(), partial[0],
+			[](const aabb& a, const aabb& b) { return a.merge(b); });
+
+		// 2) Pick a resolution that gives us about CELLS_PER_ITEM cells per item,
+		//    with cells as close to cubes as possible.
+		const float extent[3] = {
+			std::max(bounds.max.x - bounds.min.x, 0.001f),
+			std::max(bounds.max.y - bounds.min.y, 0.001f),
+			std::max(bounds.max.z - bounds.min.z, 0.001f)
+		};
+		float cells_per_unit = cbrtf(CELLS_PER_ITEM * count / (extent[0] * extent[1] * extent[2]));
+		const float lower[3] = { bounds.min.x, bounds.min.y, bounds.min.z };
+		for (int axis = 0; axis < 3; axis++) {
+			resolution[axis] = std::clamp(int(extent[axis] * cells_per_unit), 1, MAX_RESOLUTION);
+			cell_size[axis] = extent[axis] / resolution[axis];
+			inv_cell_size[axis] = 1.0f / cell_size[axis];
+			origin[axis] = lower[axis];
+		}
+		const int cell_count = resolution[0] * resolution[1] * resolution[2];
+
+		// 3) Count how many items overlap each cell.
+		std::vector<std::atomic<uint32_t>> counters(cell_count);
+		pool.ParallelFor(count, [&](int i) {
+			ForEachCell(boxes[i], [&](int cell) { counters[cell].fetch_add(1, std::memory_order_relaxed); });
+		});
+
+		// 4) Turn those counts into offsets (an exclusive prefix sum). This is
+		//    a single pass over the cells, which is O(n) by construction.
+		cell_starts.resize(cell_count + 1);
+		uint32_t total = 0;
+		for (int cell = 0; cell < cell_count; cell++) {
+			cell_starts[cell] = total;
+			total += counters[cell].load(std::memory_order_relaxed);
+			counters[cell].store(cell_starts[cell], std::memory_order_relaxed);
+		}
+		cell_starts[cell_count] = total;
+
+		// 5) Scatter each item's index into every cell it overlaps.
+		items.resize(total);
+		pool.ParallelFor(count, [&](int i) {
+			ForEachCell(boxes[i], [&](int cell) { items[counters[cell].fetch_add(1, std::memory_order_relaxed)] = uint32_t(i); });
+		});
+	}
 
-			// If we didn't intersect with any Shapes, return an empty optional.
-			if (intersected_shape_iterator == shapes.end())
-				return {};
+	// Walk the cells a ray passes through, nearest first, calling
+	// visit(cell_items, cell_exit_distance) for each non-empty cell until
+	// visit returns true or the ray passes max_distance.
+	template <typename F>
+	void Traverse(ray r, float max_distance, const F& visit) const {
+		if (items.empty()) return;
+
+		// Clip the ray to the grid.
+		auto range = bounds.intersection(r);
+		if (!range) return;
+		float t_enter = std::max(range->first, 0.0f);
+		float t_exit = std::min(range->second, max_distance);
+		if (t_enter > t_exit) return;
+
+		// Set up the DDA: which cell we start in, which way we step along each
+		// axis, the distance to the next cell boundary and the distance between
+		// boundaries.
+		const float ray_origin[3] = { r.origin.x, r.origin.y, r.origin.z };
+		const float direction[3] = { r.direction.x, r.direction.y, r.direction.z };
+		int cell[3], step[3];
+		float t_next[3], t_delta[3];
+		for (int axis = 0; axis < 3; axis++) {
+			float entry = ray_origin[axis] + direction[axis] * t_enter;
+			cell[axis] = std::clamp(int((entry - origin[axis]) * inv_cell_size[axis]), 0, resolution[axis] - 1);
+			if (direction[axis] > 0) {
+				step[axis] = 1;
+				t_next[axis] = (origin[axis] + (cell[axis] + 1) * cell_size[axis] - ray_origin[axis]) / direction[axis];
+				t_delta[axis] = cell_size[axis] / direction[axis];
+			} else if (direction[axis] < 0) {
+				step[axis] = -1;
+				t_next[axis] = (origin[axis] + cell[axis] * cell_size[axis] - ray_origin[axis]) / direction[axis];
+				t_delta[axis] = -cell_size[axis] / direction[axis];
+			} else {
+				step[axis] = 0;
+				t_next[axis] = INFINITY;
+				t_delta[axis] = INFINITY;
+			}
 		}
 
-		// Get the shape we discovered
-		const Shape &intersected_shape = **intersected_shape_iterator;
+		while (true) {
+			// The axis whose next boundary is closest is the one we cross next.
+			int axis = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
 
-		// Quick check - if the intersection is further away than the furthest Fog point,
-		// then we can save some time and not calculate anything further, since it would
-		// be obscured by Fog regardless.
-		if (intersection_distance >= FOG_INTENSITY_INVERSE)
-			return FOG;
+			int index = (cell[2] * resolution[1] + cell[1]) * resolution[0] + cell[0];
+			std::span<const uint32_t> cell_items(items.data() + cell_starts[index], items.data() + cell_starts[index + 1]);
+			if (!cell_items.empty() && visit(cell_items, std::min(t_next[axis], t_exit)))
+				return;
 
-		// Set our color to the sampled color of the Shape this ray with.
-		final_color = intersected_shape.sample(r);
+			// Step into the next cell, stopping when we leave the grid or pass max_distance.
+			if (t_next[axis] > t_exit) return;
+			cell[axis] += step[axis];
+			if (cell[axis] < 0 || cell[axis] >= resolution[axis]) return;
+			t_next[axis] += t_delta[axis];
+		}
+	}
 
-		// Determine the point at which our ray intersects our Shape.
-		vf3d intersection_point = (r * intersection_distance).end();
-		// Calculate the normal of the given Shape at that point.
-		ray normal = intersected_shape.normal(intersection_point);
+	// The number of cells in the grid.
+	int cell_count() const { return int(cell_starts.size()) - 1; }
+
+	// Get the index of the cell containing a point (or -1, if the point is
+	// outside the grid).
+	int CellAt(vf3d point) const {
+		if (items.empty()) return -1;
 
-		// Apply reflection
-		if (bounces != 0 && intersected_shape.reflectivity > 0) {
-			// Our reflection ray starts out as our normal...
-			ray reflection = normal;
+		const float position[3] = { point.x, point.y, point.z };
+		int cell[3];
+		for (int axis = 0; axis < 3; axis++) {
+			float offset = (position[axis] - origin[axis]) * inv_cell_size[axis];
+			if (offset < 0 || offset >= resolution[axis]) return -1;
+			cell[axis] = int(offset);
+		}
 
-			// Apply a slight offset *along* the normal. This way our reflected ray will
-			// start at some slight offset from the surface so that rounding errors don't
-			// cause it to collide with the Shape it originated from!
-			reflection.origin = reflection.origin + (normal.direction + 0.001f);
+		return (cell[2] * resolution[1] + cell[1]) * resolution[0] + cell[0];
+	}
 
-			// Reflect the direction around the normal with some simple geometry.
-			reflection.direction = (normal.direction * (2 * ((r.direction * -1) * normal.direction)) + r.direction).normalize();
+	// Get the items in a cell.
+	std::span<const uint32_t> CellItems(int cell) const {
+		return { items.data() + cell_starts[cell], items.data() + cell_starts[cell + 1] };
+	}
 
-			// Recursion! Since SampleRay doesn't care if the ray is coming from the
-			// canvas, we can use it to get the color that will be reflected by this Shape!
-			std::optional<color3> reflected_color = SampleRay(reflection, bounces);
+	// Get the items in the cell containing a point (or none, if the point is
+	// outside the grid).
+	std::span<const uint32_t> ItemsAt(vf3d point) const {
+		int cell = CellAt(point);
+		if (cell < 0) return {};
+		return CellItems(cell);
+	}
 
-			// Finally, mix our Shape's color with the reflected color (or Fog color, in case
-			// of a miss) according to the reflectivity.
-			final_color = lerp(final_color, reflected_color.value_or(FOG), intersected_shape.reflectivity);
+private:
+	aabb bounds;
+	int resolution[3] = { 1, 1, 1 };
+	float origin[3] = {}, cell_size[3] = {}, inv_cell_size[3] = {};
+
+	// Item indices, grouped by cell: cell c holds items[cell_starts[c]..cell_starts[c + 1]).
+	std::vector<uint32_t> cell_starts, items;
+
+	// Call fn(cell_index) for every cell a bounding box overlaps.
+	template <typename F>
+	void ForEachCell(const aabb& box, const F& fn) const {
+		const float lower[3] = { box.min.x, box.min.y, box.min.z };
+		const float upper[3] = { box.max.x, box.max.y, box.max.z };
+		int first[3], last[3];
+		for (int axis = 0; axis < 3; axis++) {
+			first[axis] = std::clamp(int((lower[axis] - origin[axis]) * inv_cell_size[axis]), 0, resolution[axis] - 1);
+			last[axis] = std::clamp(int((upper[axis] - origin[axis]) * inv_cell_size[axis]), 0, resolution[axis] - 1);
 		}
+		for (int z = first[2]; z <= last[2]; z++)
+			for (int y = first[1]; y <= last[1]; y++)
+				for (int x = first[0]; x <= last[0]; x++)
+					fn((z * resolution[1] + y) * resolution[0] + x);
+	}
+};
 
-		// Apply lighting
+// The ways we can search a scene for the Shapes a ray intersects.
+enum class Acceleration {
+	// Check every Shape.
+	BruteForce,
+	// Keep bounded Shapes in a UniformGrid, rebuilt every frame.
+	UniformGrid,
+};
 
-		// First we'll get the un-normalized ray from our intersection point to the light source.
-		ray light_ray = ray(intersection_point, light_point - intersection_point);
-		// Get the distance to the light (equal to the length of the un-normalized ray).
-		float light_distance = light_ray.direction.length();
-		// We'll also offset the origin of the light ray by a small amount along the
-		// surface normal so the ray doesn't intersect with this Shape itself.
-		light_ray.origin = light_ray.origin + (normal.direction * 0.001f);
-		// And finally we'll normalize the light_ray.
- 		light_ray.direction = light_ray.direction.normalize();
-
-		// Then we'll search for any Shapes that is occluding the light_ray,
-		// using more or less our existing search code.
-		// We initialize closest_distance to our light distance, because we
-		// don't care if any of the Shapes intersect the ray beyond the light.
-		float closest_distance = light_distance;
-		for (auto& shape : shapes) {
-			if (float distance = shape->intersection(light_ray).value_or(INFINITY);
-				distance < closest_distance) {
-				closest_distance = distance;
-			}
-		}
+// Picks items at random in proportion to their weights, in constant time no
+// matter how many items there are (Vose's alias method). Every item gets an
+// equal slice of [0, 1), which it shares with (at most) one other "alias" item,
+// so picking an item only takes one random number and one comparison.
+class AliasTable {
+public:
+	/* METHODS */
 
-		// Check if we had an intersection (the light is occluded).
-		if (closest_distance < light_distance) {
-			// Multiplying our final color by the ambient light darkens this surface "entirely".
-			final_color = final_color * AMBIENT_LIGHT;
-		}  else {
-			// Next we'll compute the dot product between our surface normal and the light ray.
-			// We need to clamp this between 0 and 1, because negative values have no meaning here.
-			// Additionally, we'll add in our ambient light so no surfaces are entirely dark.
-			float dot = std::clamp(AMBIENT_LIGHT + (light_ray.direction * normal.direction), 0.0f, 1.0f);
+	// The number of items in the table.
+	size_t size() const { return probability.size(); }
+
+	// Rebuild the table for `count` items, so that item i is picked with probability
+	// weight(i) / (sum of weights). If every weight is 0, items are picked uniformly instead.
+	template <typename F>
+	void Build(size_t count, const F& weight) {
+		probability.resize(count);
+		alias.resize(count);
+		pdf.resize(count);
+		if (count == 0) return;
+
+		float total = 0;
+		for (size_t i = 0; i < count; i++)
+			total += pdf[i] = weight(i);
+
+		// Scale the weights so the average is 1, and sort them into those that don't
+		// fill their own slice (small) and those that overflow it (large).
+		small.clear();
+		large.clear();
+		for (size_t i = 0; i < count; i++) {
+			pdf[i] = total > 0 ? pdf[i] / total : 1.0f / count;
+			probability[i] = pdf[i] * count;
+			(probability[i] < 1 ? small : large).push_back(uint32_t(i));
+		}
 
-			// Multiplying our final color by this dot product darkens surfaces pointing away from the light.
-			final_color = final_color * dot;
+		// Fill each small item's slice with some of a large item, which may leave
+		// that large item small itself.
+		while (!small.empty() && !large.empty()) {
+			uint32_t less = small.back(), more = large.back();
+			small.pop_back();
+			alias[less] = more;
+			probability[more] -= 1 - probability[less];
+			if (probability[more] < 1) {
+				large.pop_back();
+				small.push_back(more);
+			}
 		}
 
-		// Apply Fog
-		if (FOG_INTENSITY)
-			final_color = lerp(final_color, FOG, intersection_distance * FOG_INTENSITY);
+		// Whatever is left (only off by rounding errors) fills its own slice.
+		for (uint32_t i : small) probability[i] = 1;
+		for (uint32_t i : large) probability[i] = 1;
+	}
 
-		return final_color;
+	// Pick an item using a random number in [0, 1), returning its index and the
+	// probability that it was picked.
+	std::pair<uint32_t, float> Sample(float random) const {
+		float scaled = random * probability.size();
+		uint32_t slice = std::min(uint32_t(scaled), uint32_t(probability.size() - 1));
+		uint32_t item = scaled - slice < probability[slice] ? slice : alias[slice];
+		return { item, pdf[item] };
 	}
 
 private:
+	// For each slice: how much of it belongs to its own item, the item that owns
+	// the rest, and the probability of picking that slice's item overall.
+	std::vector<float> probability;
+	std::vector<uint32_t> alias;
+	std::vector<float> pdf;
+
+	// Space for sorting items while building.
+	std::vector<uint32_t> small, large;
+};
 
-	// A vector of Shape smart pointers representing our scene.
-	// Because these are smart pointers we can point to subclasses of Shape.
-	std::vector<std::unique_ptr<Shape>> shapes;
+// Remembers how much of each area light can be seen from points in the scene, so the
+// parts of a scene that don't change don't need new shadow rays every frame.
+// Points are grouped into small cubes CELL_SIZE wide, and each cube's entry
+// remembers the frame ("epoch") it was last known to be right. An entry is
+// thrown away when its Light moves, or when anything that moved since then
+// crossed the path between the cube and the Light.
+class ShadowCache {
+public:
+	// The width of the cubes points are grouped into.
+	static constexpr float CELL_SIZE = 8.0f;
+	// How many entries there are (as a power of two). Entries that land in the
+	// same slot simply replace each other.
+	static constexpr int TABLE_BITS = 18;
+	// How many frames of moved bounds to keep. Older entries are thrown away.
+	static constexpr uint32_t HISTORY = 64;
+	// How many times to average a Light's (noisy) visibility before reusing it.
+	static constexpr int SAMPLES = 8;
 
-	// Apply a linear interpolation between two colors:
-	//  from |-------------------------------| to
-	//                ^ by
-	color3 lerp(color3 from, color3 to, float by) const {
+	/* CONSTRUCTORS */
+
+	ShadowCache() : entries(size_t(1) << TABLE_BITS) {}
+
+	/* METHODS */
+
+	// Start a new frame, forgetting bounds that moved too long ago to matter.
+	void BeginFrame() {
+		epoch++;
+		while (!moved.empty() && moved.front().first + HISTORY < epoch)
+			moved.erase(moved.begin());
+	}
+
+	// Record that something occupying a box (wherever it was, or is now) moved.
+	void Moved(const aabb& box) { moved.emplace_back(epoch, box); }
+
+	// Record that something without bounds moved, which could change every shadow.
+	void MovedEverywhere() { valid_from = epoch; }
+
+	// Record that a Light moved, which changes all of its shadows.
+	void LightMoved(uint32_t light) {
+		if (light >= light_epochs.size())
+			light_epochs.resize(light + 1, 0);
+		light_epochs[light] = epoch;
+	}
+
+	// Get how much of a Light can be seen from a point, if we've seen it at least
+	// `samples` times and nothing has changed since. Otherwise, the entry is reset
+	// (if needed) to start averaging new samples passed to Store.
+	std::optional<float> Lookup(vf3d point, uint32_t light, vf3d light_origin, float light_extent, int samples) {
+		Entry& entry = Find(point, light);
+		if (!IsValid(entry, Key(point, light), point, light, light_origin, light_extent)) {
+			entry = { Key(point, light), epoch, 0, 0 };
+			return {};
+		}
+
+		// It's still right, so we don't need to check anything before now again.
+		entry.epoch = epoch;
+		if (entry.count < samples)
+			return {};
+		return entry.visibility / entry.count;
+	}
+
+	// Add a newly measured visibility of a Light from a point (after Lookup missed).
+	void Store(vf3d point, uint32_t light, float visibility) {
+		Entry& entry = Find(point, light);
+		entry.visibility += visibility;
+		entry.count++;
+	}
+
+private:
+	// A cube and Light, packed into a key.
+	struct CellKey {
+		int32_t x = INT32_MIN, y = 0, z = 0;
+		uint32_t light = 0;
+		bool operator==(const CellKey&) const = default;
+	};
+
+	// What we know about one cube and Light: the sum (and count) of visibilities
+	// measured, and the last frame they were known to be right.
+	struct Entry {
+		CellKey key;
+		uint32_t epoch = 0;
+		float visibility = 0;
+		int count = 0;
+	};
+
+	std::vector<Entry> entries;
+	uint32_t epoch = 1, valid_from = 0;
+	std::vector<uint32_t> light_epochs;
+	// The boxes that moved in recent frames, oldest first.
+	std::vector<std::pair<uint32_t, aabb>> moved;
+
+	// Find the cube containing a point.
+	static CellKey Key(vf3d point, uint32_t light) {
+		return { int32_t(floorf(point.x / CELL_SIZE)), int32_t(floorf(point.y / CELL_SIZE)), int32_t(floorf(point.z / CELL_SIZE)), light };
+	}
+
+	// Find the slot for a point and Light.
+	Entry& Find(vf3d point, uint32_t light) {
+		CellKey key = Key(point, light);
+		uint32_t hash = uint32_t(key.x) * 73856093u ^ uint32_t(key.y) * 19349663u ^ uint32_t(key.z) * 83492791u ^ key.light * 2654435761u;
+		return entries[hash & (entries.size() - 1)];
+	}
+
+	// Is an entry for this cube and Light, and still right?
+	bool IsValid(const Entry& entry, const CellKey& key, vf3d point, uint32_t light, vf3d light_origin, float light_extent) const {
+		if (!(entry.key == key) || entry.epoch < valid_from || entry.epoch + HISTORY < epoch)
+			return false;
+		if (light < light_epochs.size() && entry.epoch < light_epochs[light])
+			return false;
+
+		// Did anything that moved since then cross the path from here to the Light?
+		// (Area lights widen that path, so we grow each box by the Light's size.)
+		ray path(point, light_origin - point);
+		for (auto it = moved.rbegin(); it != moved.rend() && it->first > entry.epoch; ++it) {
+			aabb box(it->second.min - light_extent, it->second.max + light_extent);
+			if (auto range = box.intersection(path); range && range->first <= 1)
+				return false;
+		}
+		return true;
+	}
+};
+
+/***** FRAME PACING *****/
+
+// Watches how long frames take to render, and picks a render resolution (and,
+// if that isn't enough, a sample count) for the next frame to stay within a
+// frame time budget.
+class ResolutionController {
+public:
+	// The smallest fraction of the full resolution we'll render at.
+	static constexpr float MIN_SCALE = 0.25f;
+	// Frame times within this fraction of the budget leave everything as it is.
+	static constexpr float TOLERANCE = 0.1f;
+	// The most the scale can change by in a single frame.
+	static constexpr float MAX_STEP = 0.1f;
+
+	/* CONSTRUCTORS */
+
+	// A budget of zero (or less) always renders at full resolution and max_samples.
+	ResolutionController(float budget_ms, int full_width, int full_height, int max_samples)
+		: budget_ms(budget_ms), full_width(full_width), full_height(full_height), max_samples(max_samples), samples(max_samples) {}
+
+	/* METHODS */
+
+	// The resolution and sample count to render the next frame with.
+	int width() const { return std::max(1, int(full_width * scale + 0.5f)); }
+	int height() const { return std::max(1, int(full_height * scale + 0.5f)); }
+	int sample_count() const { return samples; }
+
+	// The most samples a frame is rendered with (when there's time for them).
+	int max_sample_count() const { return max_samples; }
+
+	// Record how long the last frame took to render.
+	void Update(float frame_ms) {
+		if (budget_ms <= 0) return;
+
+		// Smooth out noisy frame times.
+		average_ms = average_ms > 0 ? average_ms * 0.75f + frame_ms * 0.25f : frame_ms;
+		float ratio = average_ms / budget_ms;
+		if (std::abs(ratio - 1) <= TOLERANCE) return;
+
+		// Render time grows with the number of pixels, so with the square of the scale.
+		float target_scale = std::clamp(scale / std::sqrt(ratio), scale * (1 - MAX_STEP), scale * (1 + MAX_STEP));
+
+		if (ratio > 1 && scale <= MIN_SCALE && samples > 1) {
+			// Already at our lowest resolution, so take fewer samples instead.
+			samples /= 2;
+			average_ms /= 2;
+		} else if (ratio < 1 && target_scale >= 1 && samples < max_samples && ratio * 2 < 1 - TOLERANCE) {
+			// At full resolution with time to spare: take more samples again.
+			samples = std::min(samples * 2, max_samples);
+			average_ms *= 2;
+		}
+
+		scale = std::clamp(target_scale, MIN_SCALE, 1.0f);
+	}
+
+private:
+	float budget_ms;
+	int full_width, full_height, max_samples;
+
+	// Our current choices, and the smoothed frame time they produced.
+	float scale = 1;
+	int samples;
+	float average_ms = 0;
+};
+
+/***** IMAGE FILTERS *****/
+
+// Sample an image between its pixels with bilinear filtering. (u, v) is
+// measured in pixels from the top left corner of the image, so each pixel's
+// center is at +0.5. Pixels beyond the edges repeat the nearest edge pixel.
+inline color3 SampleBilinear(std::span<const color3> image, int width, int height, float u, float v) {
+	// Find the two rows and columns around this point, and how far between them it is.
+	u = std::clamp(u - 0.5f, 0.0f, width - 1.0f);
+	v = std::clamp(v - 0.5f, 0.0f, height - 1.0f);
+	int x0 = int(u), x1 = std::min(x0 + 1, width - 1);
+	int y0 = int(v), y1 = std::min(y0 + 1, height - 1);
+	float fx = u - x0, fy = v - y0;
+
+	// Blend horizontally along both rows, then vertically between them.
+	color3 top = image[y0 * width + x0] * (1 - fx) + image[y0 * width + x1] * fx;
+	color3 bottom = image[y1 * width + x0] * (1 - fx) + image[y1 * width + x1] * fx;
+	return top * (1 - fy) + bottom * fy;
+}
+
+// Resize an image with bilinear filtering.
+inline void UpscaleBilinear(std::span<const color3> source, int source_width, int source_height,
+		std::span<color3> target, int target_width, int target_height) {
+	float scale_x = source_width / (float)target_width;
+	float scale_y = source_height / (float)target_height;
+
+	for (int y = 0; y < target_height; y++)
+		for (int x = 0; x < target_width; x++)
+			target[y * target_width + x] = SampleBilinear(source, source_width, source_height, (x + 0.5f) * scale_x, (y + 0.5f) * scale_y);
+}
+
+// Blend a new frame into the history of previous frames. Each pixel finds its
+// history by following its motion vector (in pixels) back to where it was last
+// frame. History that comes from off screen is dropped, and history unlike
+// anything around the pixel now (usually something that was just uncovered) is
+// clamped to the range of colors in its 3x3 neighborhood.
+inline void TemporalAccumulate(std::span<const color3> current, std::span<const olc::vf2d> motion,
+		std::span<const color3> history, std::span<color3> output, int width, int height, float current_weight) {
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int index = y * width + x;
+
+			// Where was this pixel last frame?
+			float u = x + 0.5f - motion[index].x;
+			float v = y + 0.5f - motion[index].y;
+			if (u < 0 || v < 0 || u > width || v > height) {
+				output[index] = current[index];
+				continue;
+			}
+
+			// Find the range of colors around this pixel in the new frame.
+			color3 low = current[index], high = current[index];
+			for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+				for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+					const color3& c = current[ny * width + nx];
+					low = color3(std::min(low.x, c.x), std::min(low.y, c.y), std::min(low.z, c.z));
+					high = color3(std::max(high.x, c.x), std::max(high.y, c.y), std::max(high.z, c.z));
+				}
+			}
+
+			// Clamp our history to that range, and blend in the new frame.
+			color3 previous = SampleBilinear(history, width, height, u, v);
+			previous = color3(std::clamp(previous.x, low.x, high.x), std::clamp(previous.y, low.y, high.y), std::clamp(previous.z, low.z, high.z));
+			output[index] = previous * (1 - current_weight) + current[index] * current_weight;
+		}
+	}
+}
+
+// Which pixels of a frame get traced, when only 1 of every `pattern` pixels is
+// traced each frame: 1 (all of them), 2 (a checkerboard) or 4 (one pixel of
+// every 2x2 block). `phase` picks which set of pixels this frame traces, so
+// cycling through phases traces every pixel.
+struct Interleave {
+	int pattern = 1, phase = 0;
+
+	// Is pixel (x, y) traced?
+	bool traced(int x, int y) const {
+		switch (pattern) {
+		case 2: return (x + y + phase) % 2 == 0;
+		case 4: return x % 2 + (y % 2) * 2 == phase;
+		default: return true;
+		}
+	}
+
+	// The first traced pixel of row y (or width, if none are).
+	int first(int y, int width) const {
+		switch (pattern) {
+		case 2: return (y + phase) % 2;
+		case 4: return y % 2 == phase / 2 ? phase % 2 : width;
+		default: return 0;
+		}
+	}
+
+	// The distance between traced pixels in a row.
+	int step() const { return pattern == 1 ? 1 : 2; }
+};
+
+// Fill in the pixels of a frame that weren't traced from the previous frame,
+// clamped to the range of colors of the traced pixels around them (so
+// anything that moved doesn't leave a trail behind). Without a previous frame,
+// the traced pixels around them are averaged instead.
+inline void ReconstructInterleaved(std::span<color3> pixels, std::span<const color3> previous,
+		int width, int height, Interleave interleave) {
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			if (interleave.traced(x, y)) continue;
+
+			// Find the range (and sum) of the traced pixels around this one.
+			color3 low(INFINITY), high(-INFINITY), sum(0.0f);
+			int count = 0;
+			for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+				for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+					if (!interleave.traced(nx, ny)) continue;
+					const color3& c = pixels[ny * width + nx];
+					low = color3(std::min(low.x, c.x), std::min(low.y, c.y), std::min(low.z, c.z));
+					high = color3(std::max(high.x, c.x), std::max(high.y, c.y), std::max(high.z, c.z));
+					sum = sum + c;
+					count++;
+				}
+			}
+
+			// A pixel on the edge of the frame may have no traced pixels around it.
+			color3& pixel = pixels[y * width + x];
+			if (count == 0)
+				pixel = previous.empty() ? color3(0.0f) : previous[y * width + x];
+			else if (previous.empty())
+				pixel = sum / (float)count;
+			else {
+				const color3& p = previous[y * width + x];
+				pixel = color3(std::clamp(p.x, low.x, high.x), std::clamp(p.y, low.y, high.y), std::clamp(p.z, low.z, high.z));
+			}
+		}
+	}
+}
+
+// What the center of a pixel sees, to guide DenoiseATrous: the surface normal,
+// the distance to the surface, and the surface's own color (before lighting).
+// Pixels that see nothing have a depth of 0 (and all face the camera, so they
+// blend with each other but nothing else).
+struct SurfaceInfo {
+	vf3d normal = vf3d(0, 0, -1);
+	float depth = 0;
+	color3 albedo = color3(0.0f);
+};
+
+// How many passes DenoiseATrous makes. Each pass spaces its taps twice as far
+// apart, so 3 passes blur across up to 15 pixels.
+constexpr int DENOISE_PASSES = 3;
+// How different (in color) neighbors can be before they stop being blended in.
+// This is halved every pass, so later (wider) passes only smooth out small noise.
+constexpr float DENOISE_COLOR_SIGMA = 0.4f;
+// How closely neighbors' normals have to match (roughly, the power their dot
+// product is raised to).
+constexpr int DENOISE_NORMAL_POWER = 64;
+// How different neighbors' depths can be, relative to this pixel's depth.
+constexpr float DENOISE_DEPTH_SIGMA = 0.02f;
+// How different neighbors' albedos can be.
+constexpr float DENOISE_ALBEDO_SIGMA = 0.1f;
+
+// One pass of DenoiseATrous over a single row: blend each pixel with its 3x3
+// neighbors `step` pixels apart, weighting each neighbor by how alike their
+// colors, normals, depths and albedos are.
+inline void DenoiseATrousRow(std::span<const color3> input, std::span<color3> output, std::span<const SurfaceInfo> surfaces,
+		int width, int height, int y, int step, float color_sigma) {
+	// The 1D kernel (1/4, 1/2, 1/4), applied in both directions.
+	constexpr float KERNEL[3] = { 0.25f, 0.5f, 0.25f };
+	constexpr float ALBEDO_SCALE = 1 / (DENOISE_ALBEDO_SIGMA * DENOISE_ALBEDO_SIGMA);
+	const float color_scale = 1 / (color_sigma * color_sigma);
+
+	// The rows of neighbors above and below (taps beyond the edges repeat the
+	// nearest edge pixel).
+	const int rows[3] = {
+		std::max(y - step, 0) * width,
+		y * width,
+		std::min(y + step, height - 1) * width,
+	};
+
+	for (int x = 0; x < width; x++) {
+		const int index = y * width + x;
+		const color3& color = input[index];
+		const SurfaceInfo& surface = surfaces[index];
+		// Depths are compared relative to this pixel's depth.
+		const float depth_scale = 1 / (DENOISE_DEPTH_SIGMA * DENOISE_DEPTH_SIGMA * std::max(surface.depth * surface.depth, 1.0f));
+		const int columns[3] = { std::max(x - step, 0), x, std::min(x + step, width - 1) };
+
+		// This pixel always counts fully, so start with it.
+		color3 sum = color * (KERNEL[1] * KERNEL[1]);
+		float total = KERNEL[1] * KERNEL[1];
+
+		for (int ky = 0; ky < 3; ky++) {
+			for (int kx = 0; kx < 3; kx++) {
+				if (kx == 1 && ky == 1) continue;
+				const int neighbor = rows[ky] + columns[kx];
+				const color3& neighbor_color = input[neighbor];
+				const SurfaceInfo& other = surfaces[neighbor];
+
+				// Differences in color, albedo, depth and normal (where 1 - the dot
+				// product of the normals stands in for how far apart they point) add
+				// up to a single distance.
+				vf3d color_difference = neighbor_color - color;
+				vf3d albedo_difference = other.albedo - surface.albedo;
+				float depth_difference = other.depth - surface.depth;
+				float distance = (color_difference * color_difference) * color_scale +
+					(albedo_difference * albedo_difference) * ALBEDO_SCALE +
+					depth_difference * depth_difference * depth_scale +
+					(1 - surface.normal * other.normal) * DENOISE_NORMAL_POWER;
+
+				// The weight falls off like exp(-distance). Instead of calling exp(), we
+				// use (1 - distance / 16)^16, which is close enough and much cheaper.
+				// Anything over 15 counts for nothing (which also stops the powers
+				// underflowing into very slow denormal floats).
+				float falloff = 1 - distance / 16;
+				if (falloff < 1 / 16.0f) continue;
+				for (int power = 1; power < 16; power *= 2)
+					falloff *= falloff;
+
+				float weight = KERNEL[kx] * KERNEL[ky] * falloff;
+				sum = sum + neighbor_color * weight;
+				total += weight;
+			}
+		}
+
+		output[index] = sum / total;
+	}
+}
+
+// Remove noise from an image while keeping its edges sharp, using an
+// "edge-avoiding a-trous wavelet" filter: a small blur repeated with its taps
+// spread further apart each pass, which only blends pixels that see similar
+// surfaces. `scratch` must be as large as `pixels`. Rows are split across `pool`.
+inline void DenoiseATrous(std::span<color3> pixels, std::span<color3> scratch, std::span<const SurfaceInfo> surfaces,
+		int width, int height, WorkerPool& pool) {
+	std::span<color3> input = pixels, output = scratch;
+	float color_sigma = DENOISE_COLOR_SIGMA;
+
+	for (int pass = 0; pass < DENOISE_PASSES; pass++) {
+		pool.ParallelFor(height, [&](int y) {
+			DenoiseATrousRow(input, output, surfaces, width, height, y, 1 << pass, color_sigma);
+		});
+
+		// This pass's output is the next pass's input.
+		std::swap(input, output);
+		color_sigma /= 2;
+	}
+
+	// Make sure the result ends up in pixels.
+	if (input.data() != pixels.data())
+		std::copy(input.begin(), input.end(), pixels.begin());
+}
+
+// Curves that squeeze the (unlimited) light we render into the 0-1 range a
+// screen can show.
+enum class Tonemap {
+	// Leave colors alone, so anything brighter than 1 is clipped when drawn.
+	Clamp,
+	// c / (1 + c): brightness rolls off smoothly, though colors wash out a little.
+	Reinhard,
+	// Krzysztof Narkowicz's fit of the ACES filmic curve: more contrast in the
+	// shadows, and a softer roll off into white.
+	ACES,
+};
+
+// Map a single channel through a tonemapping curve.
+template <Tonemap curve>
+inline float ApplyTonemap(float c) {
+	if constexpr (curve == Tonemap::Reinhard)
+		return c / (1 + c);
+	else if constexpr (curve == Tonemap::ACES)
+		return (c * (2.51f * c + 0.03f)) / (c * (2.43f * c + 0.59f) + 0.14f);
+	else
+		return c;
+}
+
+#if defined(VF3D_SSE) || defined(VF3D_NEON)
+// Map all four lanes through a tonemapping curve at once. Every curve maps 0 to
+// 0, so a vf3d's padding lane stays zero.
+template <Tonemap curve>
+inline lanes ApplyTonemap(lanes c) {
+	if constexpr (curve == Tonemap::Reinhard)
+		return lanes_div(c, lanes_add(lanes_set(1), c));
+	else if constexpr (curve == Tonemap::ACES)
+		return lanes_div(lanes_mul(c, lanes_add(lanes_mul(lanes_set(2.51f), c), lanes_set(0.03f))),
+			lanes_add(lanes_mul(c, lanes_add(lanes_mul(lanes_set(2.43f), c), lanes_set(0.59f))), lanes_set(0.14f)));
+	else
+		return c;
+}
+#endif
+
+// Scale a row of colors by an exposure, then map them through a tonemapping curve.
+template <Tonemap curve>
+inline void TonemapRow(std::span<color3> row, float exposure) {
+#if defined(VF3D_SSE) || defined(VF3D_NEON)
+	for (color3& c : row)
+		c = color3(ApplyTonemap<curve>(lanes_mul(c.v, lanes_set(exposure))));
+#else
+	for (color3& c : row)
+		c = color3(ApplyTonemap<curve>(c.x * exposure), ApplyTonemap<curve>(c.y * exposure), ApplyTonemap<curve>(c.z * exposure));
+#endif
+}
+
+/***** IMAGE OUTPUT *****/
+
+// Convert a float to a half-precision float (as EXR files store them), rounding
+// to the nearest. Anything too large becomes infinity.
+inline uint16_t FloatToHalf(float f) {
+	uint32_t bits = std::bit_cast<uint32_t>(f);
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t magnitude = bits & 0x7fffffff;
+
+	// Infinity and NaN (which must keep some of its mantissa to stay a NaN).
+	if (magnitude >= 0x7f800000)
+		return uint16_t(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+	// Too large for a half, even after rounding.
+	if (magnitude >= 0x47800000)
+		return uint16_t(sign | 0x7c00);
+	// Too small for even the smallest (denormal) half.
+	if (magnitude < 0x33000000)
+		return uint16_t(sign);
+
+	// Denormal halves: shift the mantissa (with its implied 1) down, rounding to even.
+	if (magnitude < 0x38800000) {
+		uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+		int shift = 126 - int(magnitude >> 23);
+		uint32_t half = mantissa >> shift, rest = mantissa & ((1u << shift) - 1), midpoint = 1u << (shift - 1);
+		if (rest > midpoint || (rest == midpoint && (half & 1)))
+			half++;
+		return uint16_t(sign | half);
+	}
+
+	// Normal halves: rebias the exponent, and round away 13 bits of mantissa to
+	// even. A carry out of the mantissa correctly bumps the exponent.
+	uint32_t half = (magnitude - 0x38000000) >> 13, rest = magnitude & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return uint16_t(sign | half);
+}
+
+// Writes a linear (HDR) image to a PFM or OpenEXR file a block of rows at a
+// time, so the file never needs a whole-frame copy of its own. Blocks can be
+// written from several threads at once, in any order: PFM rows go straight to
+// their place in the file, and EXR blocks (which must be in order) wait only
+// until the blocks before them have been written.
+class HdrWriter {
+public:
+	// How many rows each call to WriteBlock takes (the last block may have fewer).
+	static constexpr int BLOCK_ROWS = 16;
+
+	/* CONSTRUCTORS */
+
+	HdrWriter() = default;
+
+	// Don't copy an open file.
+	HdrWriter(const HdrWriter&) = delete;
+
+	// Finish the file, if it wasn't already.
+	~HdrWriter() { Close(); }
+
+	/* METHODS */
+
+	// Start writing a width by height image to path: an EXR file if it ends in
+	// ".exr" (with half-float channels if half, compressed if zip), and a PFM file
+	// otherwise. Returns false if the file couldn't be opened.
+	bool Open(const std::string& path, int width, int height, bool half = false, bool zip = false) {
+		Close();
+		exr = path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0;
+		file = fopen(path.c_str(), "wb");
+		if (!file) return false;
+
+		this->width = width;
+		this->height = height;
+		this->half = exr && half;
+		this->zip = exr && zip;
+
+		if (!exr) {
+			// PFM: a text header, then rows of RGB floats from the bottom up. A
+			// negative scale means little-endian.
+			fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+			data_start = ftell(file);
+			return true;
+		}
+
+		// EXR: a header of attributes, a table of where each chunk of rows starts,
+		// then the chunks. Uncompressed files have a row per chunk, and zip
+		// compressed ones 16.
+		chunk_rows = this->zip ? 16 : 1;
+		chunk_offsets.assign((height + chunk_rows - 1) / chunk_rows, 0);
+		pending.assign(block_count(), {});
+		next_block = 0;
+
+		std::vector<char> header;
+		auto put = [&](const void* data, size_t size) { header.insert(header.end(), (const char*)data, (const char*)data + size); };
+		auto put_int = [&](int32_t value) { put(&value, sizeof(value)); };
+		auto put_float = [&](float value) { put(&value, sizeof(value)); };
+		auto attribute = [&](const char* name, const char* type, int32_t size) {
+			put(name, strlen(name) + 1);
+			put(type, strlen(type) + 1);
+			put_int(size);
+		};
+
+		// Magic number, and version 2 (a single-part scanline file).
+		put_int(20000630);
+		put_int(2);
+
+		// Channels must be listed (and stored) in alphabetical order.
+		attribute("channels", "chlist", 3 * 18 + 1);
+		for (const char* channel : { "B", "G", "R" }) {
+			put(channel, 2);
+			put_int(this->half ? 1 : 2);
+			put_int(0);
+			put_int(1);
+			put_int(1);
+		}
+		header.push_back(0);
+
+		attribute("compression", "compression", 1);
+		header.push_back(this->zip ? 3 : 0);
+		for (const char* window : { "dataWindow", "displayWindow" }) {
+			attribute(window, "box2i", 16);
+			put_int(0);
+			put_int(0);
+			put_int(width - 1);
+			put_int(height - 1);
+		}
+		attribute("lineOrder", "lineOrder", 1);
+		header.push_back(0);
+		attribute("pixelAspectRatio", "float", 4);
+		put_float(1);
+		attribute("screenWindowCenter", "v2f", 8);
+		put_float(0);
+		put_float(0);
+		attribute("screenWindowWidth", "float", 4);
+		put_float(1);
+		header.push_back(0);
+
+		// Leave room for the offset table, which is filled in by Close.
+		fwrite(header.data(), 1, header.size(), file);
+		table_start = ftell(file);
+		std::vector<uint64_t> empty_table(chunk_offsets.size());
+		fwrite(empty_table.data(), sizeof(uint64_t), empty_table.size(), file);
+		return true;
+	}
+
+	// How many blocks of BLOCK_ROWS rows the image is written in.
+	int block_count() const { return (height + BLOCK_ROWS - 1) / BLOCK_ROWS; }
+
+	// Write a block of rows (starting at row block * BLOCK_ROWS, top down).
+	void WriteBlock(int block, std::span<const color3> rows) {
+		const int y = block * BLOCK_ROWS;
+		const int row_count = int(rows.size()) / width;
+
+		if (!exr) {
+			// Each row lands at its own place in the file, so order doesn't matter.
+			std::vector<float> row(3 * width);
+			std::lock_guard lock(mutex);
+			for (int i = 0; i < row_count; i++) {
+				for (int x = 0; x < width; x++) {
+					const color3& c = rows[i * width + x];
+					row[3 * x] = c.x;
+					row[3 * x + 1] = c.y;
+					row[3 * x + 2] = c.z;
+				}
+				fseek(file, data_start + long(height - 1 - (y + i)) * width * 3 * long(sizeof(float)), SEEK_SET);
+				fwrite(row.data(), sizeof(float), row.size(), file);
+			}
+			return;
+		}
+
+		// Encode the block's chunks without holding the lock...
+		std::vector<char> encoded;
+		for (int first = 0; first < row_count; first += chunk_rows)
+			EncodeChunk(y + first, rows.subspan(first * width, std::min(chunk_rows, row_count - first) * width), encoded);
+
+		// ...then write it, along with any later blocks that were waiting on it.
+		std::lock_guard lock(mutex);
+		pending[block] = std::move(encoded);
+		for (; next_block < int(pending.size()) && !pending[next_block].empty(); next_block++) {
+			std::vector<char>& chunks = pending[next_block];
+			uint64_t offset = uint64_t(ftell(file));
+			for (size_t pos = 0; pos < chunks.size();) {
+				// Each chunk starts with its first row, and the size of its data.
+				int32_t chunk_y, size;
+				memcpy(&chunk_y, &chunks[pos], sizeof(chunk_y));
+				memcpy(&size, &chunks[pos + 4], sizeof(size));
+				chunk_offsets[chunk_y / chunk_rows] = offset + pos;
+				pos += 8 + size;
+			}
+			fwrite(chunks.data(), 1, chunks.size(), file);
+			std::vector<char>().swap(chunks);
+		}
+	}
+
+	// Finish writing the file. Returns false if anything couldn't be written.
+	bool Close() {
+		if (!file) return true;
+		if (exr) {
+			fseek(file, table_start, SEEK_SET);
+			fwrite(chunk_offsets.data(), sizeof(uint64_t), chunk_offsets.size(), file);
+		}
+		bool ok = !ferror(file);
+		ok = fclose(file) == 0 && ok;
+		file = nullptr;
+		return ok;
+	}
+
+private:
+	FILE* file = nullptr;
+	int width = 0, height = 0;
+	bool exr = false, half = false, zip = false;
+	// Where the (PFM) rows or (EXR) offset table start in the file.
+	long data_start = 0, table_start = 0;
+	std::mutex mutex;
+
+	// EXR chunks: how many rows each holds, and where each starts in the file.
+	int chunk_rows = 1;
+	std::vector<uint64_t> chunk_offsets;
+	// Blocks that are encoded but still waiting for an earlier one, and the next
+	// block to be written.
+	std::vector<std::vector<char>> pending;
+	int next_block = 0;
+
+	// Append one EXR chunk (its first row, its size and its data) for some rows.
+	void EncodeChunk(int y, std::span<const color3> rows, std::vector<char>& out) const {
+		// Each row holds all of its B values, then G, then R.
+		const size_t value_size = half ? sizeof(uint16_t) : sizeof(float);
+		std::vector<char> raw(rows.size() * 3 * value_size);
+		char* dst = raw.data();
+		for (size_t first = 0; first < rows.size(); first += width) {
+			for (int channel = 2; channel >= 0; channel--) {
+				for (int x = 0; x < width; x++) {
+					const color3& c = rows[first + x];
+					float value = channel == 0 ? c.x : channel == 1 ? c.y : c.z;
+					if (half) {
+						uint16_t h = FloatToHalf(value);
+						memcpy(dst, &h, sizeof(h));
+					} else {
+						memcpy(dst, &value, sizeof(value));
+					}
+					dst += value_size;
+				}
+			}
+		}
+
+		std::vector<char> compressed;
+#if defined(EXR_ZIP)
+		if (zip) {
+			// Split the low and high bytes of each value apart, and store each byte
+			// as the difference from the one before, which zlib compresses well.
+			std::vector<unsigned char> shuffled(raw.size());
+			size_t half_size = (raw.size() + 1) / 2;
+			for (size_t i = 0; i < raw.size(); i++)
+				shuffled[(i & 1) ? half_size + i / 2 : i / 2] = (unsigned char)raw[i];
+			for (size_t i = shuffled.size() - 1; i > 0; i--)
+				shuffled[i] = (unsigned char)(shuffled[i] - shuffled[i - 1] + 128);
+
+			uLongf size = compressBound(uLong(shuffled.size()));
+			compressed.resize(size);
+			if (compress((Bytef*)compressed.data(), &size, shuffled.data(), uLong(shuffled.size())) == Z_OK)
+				compressed.resize(size);
+			else
+				compressed.clear();
+		}
+#endif
+
+		// Chunks that don't get any smaller are stored as they are.
+		const std::vector<char>& data = !compressed.empty() && compressed.size() < raw.size() ? compressed : raw;
+		int32_t header[2] = { y, int32_t(data.size()) };
+		out.insert(out.end(), (const char*)header, (const char*)header + sizeof(header));
+		out.insert(out.end(), data.begin(), data.end());
+	}
+};
+
+// Whether a path holds exactly one printf-style frame number (like "%d" or
+// "%04d"), so it can name a sequence of files.
+inline bool IsNumberedPath(std::string_view path) {
+	size_t percent = path.find('%');
+	if (percent == std::string_view::npos) return false;
+	size_t end = path.find_first_not_of("0123456789", percent + 1);
+	return end != std::string_view::npos && path[end] == 'd' && path.find('%', end) == std::string_view::npos;
+}
+
+// Fill a frame number into a path (see IsNumberedPath).
+inline std::string NumberedPath(const std::string& pattern, int number) {
+	std::string path(snprintf(nullptr, 0, pattern.c_str(), number), '\0');
+	snprintf(path.data(), path.size() + 1, pattern.c_str(), number);
+	return path;
+}
+
+// Records every frame it's given, either as a Y4M video (to a file, or to
+// stdout to pipe into an encoder) or as a numbered sequence of PPM images.
+// Frames are copied into one of a few buffers, then converted and written on a
+// thread of our own, so the caller only waits when every buffer is still queued.
+class FrameRecorder {
+public:
+	// How many frames can wait to be written before Record blocks.
+	static constexpr int BUFFERS = 4;
+
+	/* CONSTRUCTORS */
+
+	// Record width by height frames, timestep seconds apart, to path: a Y4M file
+	// if it ends in ".y4m" (or stdout, if it's "-"), and PPM images otherwise
+	// (path must then be numbered).
+	FrameRecorder(const std::string& path, int width, int height, float timestep)
+		: path(path), width(width), height(height), y4m(!IsNumberedPath(path)) {
+		if (y4m) {
+			if (path == "-") {
+#if defined(_WIN32)
+				_setmode(_fileno(stdout), _O_BINARY);
+#endif
+				file = stdout;
+			} else {
+				file = fopen(path.c_str(), "wb");
+			}
+			if (!file) return;
+
+			// Frame rates are fractions. Whole frame rates (like 30) are written as
+			// such, and anything else as frames per million microseconds.
+			float rate = 1 / std::max(timestep, 1e-6f);
+			int numerator = int(std::lround(rate)), denominator = 1;
+			if (std::abs(rate - numerator) > 1e-3f || numerator == 0) {
+				numerator = 1000000;
+				denominator = std::max(int(std::lround(timestep * 1e6f)), 1);
+			}
+			int divisor = std::gcd(numerator, denominator);
+			fprintf(file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", width, height, numerator / divisor, denominator / divisor);
+		}
+
+		for (int i = 0; i < BUFFERS; i++) {
+			buffers[i].resize(width * height);
+			free_buffers.push_back(i);
+		}
+		writer = std::thread([this] { WriterLoop(); });
+	}
+
+	// Don't copy a running thread.
+	FrameRecorder(const FrameRecorder&) = delete;
+
+	// Write every frame still queued, then stop.
+	~FrameRecorder() {
+		if (writer.joinable()) {
+			{
+				std::lock_guard lock(mutex);
+				stopping = true;
+			}
+			changed.notify_all();
+			writer.join();
+		}
+		if (file && file != stdout)
+			fclose(file);
+		else if (file)
+			fflush(file);
+	}
+
+	/* METHODS */
+
+	// Whether the output could be opened.
+	bool ok() const { return !y4m || file != nullptr; }
+
+	// Queue a copy of a frame (which must be width by height) to be written.
+	void Record(const olc::Sprite& frame) {
+		int buffer;
+		{
+			std::unique_lock lock(mutex);
+			changed.wait(lock, [this] { return !free_buffers.empty(); });
+			buffer = free_buffers.back();
+			free_buffers.pop_back();
+		}
+
+		// Nobody else touches a buffer between leaving free_buffers and joining queued.
+		for (int y = 0; y < height; y++)
+			std::copy_n(frame.GetRow(y), width, buffers[buffer].begin() + y * width);
+
+		{
+			std::lock_guard lock(mutex);
+			queued.push_back(buffer);
+		}
+		changed.notify_all();
+	}
+
+private:
+	std::string path;
+	int width, height;
+	bool y4m;
+	FILE* file = nullptr;
+	// How many frames have been written.
+	int frames_written = 0;
+
+	std::array<std::vector<olc::Pixel>, BUFFERS> buffers;
+	// Buffers ready to be recorded into, and buffers waiting (oldest first) to be written.
+	std::vector<int> free_buffers, queued;
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool stopping = false;
+	std::thread writer;
+
+	// Write queued frames, in order, until stopped and there are none left.
+	void WriterLoop() {
+		std::vector<uint8_t> encoded;
+		while (true) {
+			int buffer;
+			{
+				std::unique_lock lock(mutex);
+				changed.wait(lock, [this] { return stopping || !queued.empty(); });
+				if (queued.empty()) return;
+				buffer = queued.front();
+				queued.erase(queued.begin());
+			}
+
+			if (y4m)
+				EncodeY4M(buffers[buffer], encoded);
+			else
+				EncodePPM(buffers[buffer], encoded);
+
+			{
+				std::lock_guard lock(mutex);
+				free_buffers.push_back(buffer);
+			}
+			changed.notify_all();
+
+			WriteFrame(encoded);
+		}
+	}
+
+	// Convert a frame to a Y4M frame: full resolution luma (Y), then blue (U) and
+	// red (V) chroma at half the resolution, in BT.601's studio range.
+	void EncodeY4M(const std::vector<olc::Pixel>& pixels, std::vector<uint8_t>& out) const {
+		const int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+		const char tag[] = "FRAME\n";
+		out.assign(tag, tag + sizeof(tag) - 1);
+		size_t luma = out.size(), u = luma + width * height, v = u + chroma_width * chroma_height;
+		out.resize(v + chroma_width * chroma_height);
+
+		for (int i = 0; i < width * height; i++) {
+			const olc::Pixel& p = pixels[i];
+			out[luma + i] = uint8_t(((66 * p.r + 129 * p.g + 25 * p.b + 128) >> 8) + 16);
+		}
+
+		// Each chroma sample covers (up to) a 2x2 block of pixels.
+		for (int cy = 0; cy < chroma_height; cy++) {
+			for (int cx = 0; cx < chroma_width; cx++) {
+				int r = 0, g = 0, b = 0, count = 0;
+				for (int y = cy * 2; y < std::min(cy * 2 + 2, height); y++) {
+					for (int x = cx * 2; x < std::min(cx * 2 + 2, width); x++) {
+						const olc::Pixel& p = pixels[y * width + x];
+						r += p.r;
+						g += p.g;
+						b += p.b;
+						count++;
+					}
+				}
+				r /= count;
+				g /= count;
+				b /= count;
+				out[u + cy * chroma_width + cx] = uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				out[v + cy * chroma_width + cx] = uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+		}
+	}
+
+	// Convert a frame to a (binary) PPM image.
+	void EncodePPM(const std::vector<olc::Pixel>& pixels, std::vector<uint8_t>& out) const {
+		std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+		out.assign(header.begin(), header.end());
+		for (const olc::Pixel& p : pixels) {
+			out.push_back(p.r);
+			out.push_back(p.g);
+			out.push_back(p.b);
+		}
+	}
+
+	// Write an encoded frame to the video, or to its own image.
+	void WriteFrame(const std::vector<uint8_t>& encoded) {
+		int number = frames_written++;
+		if (y4m) {
+			fwrite(encoded.data(), 1, encoded.size(), file);
+			return;
+		}
+
+		std::string image = NumberedPath(path, number);
+		FILE* f = fopen(image.c_str(), "wb");
+		if (!f || fwrite(encoded.data(), 1, encoded.size(), f) != encoded.size())
+			fprintf(stderr, "Couldn't write %s\n", image.c_str());
+		if (f) fclose(f);
+	}
+};
+
+// Writes files (like checkpoints) on a thread of their own. Each file is
+// written under a temporary name, then renamed over the old one, so being
+// stopped part way through writing never loses the file that was there before.
+class BackgroundWriter {
+public:
+	/* CONSTRUCTORS */
+
+	BackgroundWriter() = default;
+
+	// Don't copy a running thread.
+	BackgroundWriter(const BackgroundWriter&) = delete;
+
+	// Finish the file being written, if there is one.
+	~BackgroundWriter() { Wait(); }
+
+	/* METHODS */
+
+	// Write data to path, once the previous file (if any) is written.
+	void Write(const std::string& path, std::vector<char> data) {
+		Wait();
+		thread = std::thread([path, data = std::move(data)] {
+			std::string temporary = path + ".tmp";
+			FILE* file = fopen(temporary.c_str(), "wb");
+			bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+			if (file)
+				written = fclose(file) == 0 && written;
+
+			std::error_code error;
+			if (written)
+				std::filesystem::rename(temporary, path, error);
+			if (!written || error)
+				fprintf(stderr, "Couldn't write %s\n", path.c_str());
+		});
+	}
+
+	// Block until the file being written (if any) is written.
+	void Wait() {
+		if (thread.joinable())
+			thread.join();
+	}
+
+private:
+	std::thread thread;
+};
+
+/***** CONSTANTS *****/
+
+// Game width and height (in pixels).
+constexpr int WIDTH = 250;
+constexpr int HEIGHT = 250;
+
+// Half the game width and height (to identify the center of the screen).
+constexpr float HALF_WIDTH = WIDTH / 2.0f;
+constexpr float HALF_HEIGHT = HEIGHT / 2.0f;
+
+// Colors
+
+color3 LIGHT_GRAY(0.8f);
+color3 DARK_GRAY(0.5f);
+color3 GREY(0.75f);
+color3 RED(1.0f, 0.0f, 0.0f);
+color3 GREEN(0.0f, 1.0f, 0.0f);
+
+// Fog distance and reciprocal (falloff).
+constexpr float FOG_INTENSITY_INVERSE = 3000;
+constexpr float FOG_INTENSITY = 1 / FOG_INTENSITY_INVERSE;
+
+// A color representing scene fog.
+color3 FOG = DARK_GRAY;
+
+// Lighting
+constexpr float AMBIENT_LIGHT = 0.5f;
+
+// How far the extra Lights scattered over the floor reach.
+constexpr float LIGHT_RADIUS = 250;
+
+// How big an area light is (the radius of a sphere, or the sides of a square),
+// and the most shadow rays we'll cast towards one.
+constexpr float AREA_LIGHT_SIZE = 100;
+constexpr int MAX_SHADOW_RAYS = 64;
+
+// With path termination, reflections that would add less than MIN_CONTRIBUTION
+// to a pixel (less than one step of an 8-bit color) are skipped, and those adding
+// less than ROULETTE_THRESHOLD are traced at random ("Russian roulette").
+constexpr float MIN_CONTRIBUTION = 1 / 256.0f;
+constexpr float ROULETTE_THRESHOLD = 0.25f;
+
+#ifdef DEBUG
+constexpr int BOUNCES = 2;
+constexpr int SAMPLES = 2;
+#else
+constexpr int BOUNCES = 5;
+constexpr int SAMPLES = 4;
+#endif
+
+// Render settings that can be changed at runtime (from the command line).
+struct RenderSettings {
+	// How many times a ray may hit a Shape (the first hit plus reflections).
+	int bounces = BOUNCES;
+	// How many rays to average per pixel.
+	int samples = SAMPLES;
+	// Whether to blend distant surfaces into the fog.
+	bool fog = FOG_INTENSITY != 0;
+	// Whether to cast rays towards the light to find shadows.
+	bool shadows = true;
+	// How many frame buffers to render into on a separate thread (2 or 3), or 0
+	// to render each frame inside OnUserUpdate.
+	int pipeline_buffers = 0;
+	// How long (in milliseconds) rendering a frame should take. Frames that take
+	// longer are rendered at a lower resolution, and upscaled. 0 to disable.
+	float frame_budget = 0;
+	// Whether to render a single sample per pixel each frame, and accumulate
+	// samples across frames (following moving Shapes) instead.
+	bool temporal = false;
+	// Trace only 1 of every 2 (a checkerboard) or 4 pixels each frame, filling in
+	// the rest from the previous frame. 1 traces every pixel.
+	int interleave = 1;
+	// Whether to smooth out noise after rendering each frame (most useful with
+	// few samples per pixel).
+	bool denoise = false;
+	// How many small colored lights to scatter over the floor (besides the light
+	// that follows the mouse).
+	int extra_lights = 0;
+	// How many of the Lights that might reach a point to pick at random (weighted
+	// by how bright they are) and cast shadow rays towards, or 0 to use all of them.
+	int light_samples = 0;
+	// The shape of the light that follows the mouse.
+	Light::Type light_type = Light::Type::Point;
+	// How many small Spheres to scatter over the floor, as a dense field.
+	int sphere_field = 0;
+	// How to find the Shapes a ray intersects, or nothing to pick whatever suits
+	// the scene (a grid for a field of Spheres, and testing every Shape otherwise).
+	std::optional<Acceleration> acceleration;
+	// How many shadow rays to cast towards each area light (at full sample count).
+	int shadow_rays = 8;
+	// Whether to remember how visible each Light is from points in the scene, and
+	// only cast new shadow rays when something nearby moves.
+	bool shadow_cache = false;
+	// Whether to stop following reflections once they can barely (or not at all)
+	// change a pixel, instead of always following them for every bounce.
+	bool roulette = false;
+	// How many frames to show before exiting (0 to keep going until closed). Most
+	// useful without a display (building with OLC_PLATFORM_HEADLESS).
+	int frames = 0;
+	// How far (in seconds) to advance time each frame, or 0 to follow the clock.
+	float timestep = 0;
+	// Whether to add every frame's samples to a running average, which converges
+	// on a noise-free image. Time stops, and the light stays in the middle of the
+	// screen, so the scene holds still.
+	bool progressive = false;
+	// A file to save progressive renders to every checkpoint_every frames (and
+	// on exit), and whether to continue the render saved there. Empty to not
+	// save checkpoints.
+	std::string checkpoint;
+	int checkpoint_every = 100;
+	bool resume = false;
+	// Where to record every frame shown: a Y4M video (a ".y4m" file, or "-" for
+	// stdout), or numbered PPM images (like "frame%04d.ppm"). Empty to not record.
+	std::string record;
+	// How much to darken the corners of each frame (0 for not at all, 1 for black).
+	float vignette = 0;
+	// How to squeeze each frame into what the screen can show. This happens last,
+	// so accumulating and denoising work on the full range of light.
+	Tonemap tonemap = Tonemap::Clamp;
+	// How many stops to brighten (or, if negative, darken) each frame by before
+	// tonemapping.
+	float exposure = 0;
+	// The gamma of the screen, which colors are corrected for as they are drawn.
+	float gamma = 1;
+	// A PFM or EXR file to save every frame to before tonemapping, losing none of
+	// its range. Each frame replaces the last, unless the name is numbered (like
+	// "frame%04d.exr"). Empty to not save frames.
+	std::string hdr_output;
+	// Whether to store EXR files as half floats, and zip compress them.
+	bool hdr_half = false;
+	bool hdr_zip = false;
+};
+
+// Bounce and sample counts that get their own compile-time specialized render
+// kernel. Anything else falls back to a kernel that reads them at runtime.
+constexpr std::array KERNEL_BOUNCES = { 1, 2, 3, 4, 5 };
+constexpr std::array KERNEL_SAMPLES = { 1, 2, 4, 8 };
+
+// Template argument meaning "not known at compile time, read it from RenderSettings".
+constexpr int DYNAMIC = 0;
+
+// How much of each new frame to blend into the accumulated history (with temporal
+// accumulation, this makes each pixel an average of roughly the last 10 frames).
+constexpr float TEMPORAL_BLEND = 0.1f;
+
+/***** PIXEL GAME ENGINE CLASS *****/
+
+// Override base class with your custom functionality
+class OlcPixelRayTracer : public olc::PixelGameEngine {
+public:
+	OlcPixelRayTracer(RenderSettings settings = {})
+		: settings(settings), resolution(settings.frame_budget, WIDTH, HEIGHT, settings.temporal ? 1 : settings.samples) {
+		// Name your application
+		sAppName = "RayTracer";
+
+		// Video recorded to stdout mustn't be mixed up with our statistics.
+		if (settings.record == "-")
+			report = stderr;
+	}
+
+	// Whether OnUserCreate finished setting everything up.
+	bool created = false;
+
+public:
+	bool OnUserCreate() override {
+		// Called once at the start, so create things here
+
+		// Create a new Sphere and add it to our scene.
+		shapes.emplace_back(std::make_unique<Sphere>(vf3d(0, 0, 200), GREY, 100, 0.9f));
+
+		// Add some additional Spheres at different positions.
+		shapes.emplace_back(std::make_unique<Sphere>(vf3d(-150, +75, +300), RED, 100, 0.5f));
+		shapes.emplace_back(std::make_unique<Sphere>(vf3d(+150, -75, +100), GREEN, 100));
+
+		// Add a "floor" Plane
+		shapes.emplace_back(std::make_unique<Plane>(vf3d(0, 200, 0 ), vf3d(0, -1, 0), LIGHT_GRAY, DARK_GRAY));
+
+		// Fill the floor with a field of small Spheres, if asked: one resting on the
+		// floor in each square of a grid, nudged about within it, in random colors.
+		if (settings.sphere_field > 0) {
+			std::minstd_rand random(2);
+			std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+			const int side = int(std::ceil(std::sqrt(float(settings.sphere_field))));
+			const float spacing_x = 1200.0f / side, spacing_z = 1000.0f / side;
+			const float radius = std::min(spacing_x, spacing_z) * 0.35f;
+			for (int i = 0; i < settings.sphere_field; i++) {
+				float x = (i % side + 0.5f) * spacing_x - 600 + (unit(random) - 0.5f) * (spacing_x - 2 * radius);
+				float z = (i / side + 0.5f) * spacing_z + (unit(random) - 0.5f) * (spacing_z - 2 * radius);
+				color3 fill(unit(random), unit(random), unit(random));
+				shapes.emplace_back(std::make_unique<Sphere>(vf3d(x, 200 - radius, z), fill, radius, 0.3f));
+			}
+		}
+
+		// Add a white Light that reaches everything (and follows the mouse). Area
+		// lights face down, towards the floor.
+		Light& light = lights.emplace_back(vf3d(0, -500, -500));
+		light.type = settings.light_type;
+		light.size = AREA_LIGHT_SIZE;
+		light.edge_u = vf3d(AREA_LIGHT_SIZE, 0, 0);
+		light.edge_v = vf3d(0, 0, AREA_LIGHT_SIZE);
+
+		// Scatter any extra Lights just above the floor, each with a random color
+		// and a short reach. A fixed seed puts them in the same places every run.
+		std::minstd_rand random(1);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int i = 0; i < settings.extra_lights; i++) {
+			vf3d origin(unit(random) * 1200 - 600, 150, unit(random) * 1000);
+			color3 color(unit(random), unit(random), unit(random));
+			lights.emplace_back(origin, color, 1.0f, LIGHT_RADIUS);
+		}
+
+		// Only our first Light moves, and it reaches everything (so it isn't in the
+		// grid), so we only need to build our light grid once.
+		BuildLightGrid();
+
+		// With only a handful of Shapes, testing every Shape is fastest, but a dense
+		// field of Spheres is much faster to search with a grid.
+		acceleration = settings.acceleration.value_or(settings.sphere_field > 0 ? Acceleration::UniformGrid : Acceleration::BruteForce);
+
+		// Only upload the parts of the screen we've drawn to each frame (right now,
+		// that's all of it).
+		SetLayerDirtyTracking(0, true);
+
+		// Frames are rendered into a buffer of colors, then drawn all at once.
+		frame.pixels.resize(WIDTH * HEIGHT);
+
+		// Carry on from where a progressive render was saved, if asked.
+		if (settings.resume && !LoadCheckpoint())
+			return false;
+
+		// Every frame shown can be recorded (on a thread of its own).
+		if (!settings.record.empty()) {
+			recorder = std::make_unique<FrameRecorder>(settings.record, WIDTH, HEIGHT, settings.timestep);
+			if (!recorder->ok()) {
+				fprintf(stderr, "Couldn't open %s\n", settings.record.c_str());
+				return false;
+			}
+		}
+
+		// Path lengths are reported a second from now.
+		path_reported_at = std::chrono::steady_clock::now();
+
+		// In pipelined mode, a separate thread renders into a set of these buffers.
+		if (settings.pipeline_buffers) {
+			latest_input.sampled_at = latency_reported_at = std::chrono::steady_clock::now();
+			pipeline = std::make_unique<FramePipeline<RenderedFrame>>(settings.pipeline_buffers, frame);
+			render_thread = std::thread([this] { RenderLoop(); });
+		}
+
+		created = true;
+		return true;
+	}
+
+	bool OnUserUpdate(float fElapsedTime) override {
+		// Called once per frame
+
+		// Pressing I toggles interleaved rendering, to compare it with tracing every pixel.
+		if (GetKey(olc::Key::I).bPressed)
+			interleave_enabled = !interleave_enabled;
+
+		// Stop once we've shown as many frames as we were asked to (if any).
+		const bool running = settings.frames == 0 || ++frames_shown < settings.frames;
+
+		// Accumulate elapsed time, and sample the mouse. Recordings leave the light
+		// in the middle of the screen, so every run records the same animation, and
+		// progressive renders stop time too, so the scene holds still.
+		accumulated_time += fElapsedTime;
+		const bool fixed_light = recorder || settings.progressive;
+		int mouse_x = fixed_light ? WIDTH / 2 : GetMouseX(), mouse_y = fixed_light ? HEIGHT / 2 : GetMouseY();
+		SceneInput input = { settings.progressive ? 0 : accumulated_time, mouse_x, mouse_y, interleave_enabled, std::chrono::steady_clock::now() };
+
+		if (!pipeline) {
+			RenderScene(input, frame);
+			Present(frame);
+			return running;
+		}
+
+		// Hand the latest input to the render thread...
+		{
+			std::lock_guard lock(input_mutex);
+			latest_input = input;
+		}
+
+		// ...and present its newest frame, if it has finished one since last time.
+		if (const RenderedFrame* finished = pipeline->TakeLatest())
+			Present(*finished);
+		else
+			// Nothing new to show, so give the render thread our share of the CPU.
+			std::this_thread::yield();
+
+		return running;
+	}
+
+	bool OnUserDestroy() override {
+		// Stop the render thread (if we started one).
+		if (pipeline) {
+			pipeline->Stop();
+			render_thread.join();
+		}
+
+		// Finish writing any frames still waiting to be recorded.
+		recorder.reset();
+
+		// Save where our progressive render got to, and wait until it's written.
+		if (!settings.checkpoint.empty() && !progressive_samples.empty())
+			SaveCheckpoint();
+		checkpoint_writer.Wait();
+		return true;
+	}
+
+	// Everything from the engine thread that a frame depends on.
+	struct SceneInput {
+		float time = 0;
+		int mouse_x = 0, mouse_y = 0;
+		bool interleave = false;
+		// When the input was sampled, to measure latency.
+		std::chrono::steady_clock::time_point sampled_at;
+	};
+
+	// A rendered image, how it was rendered, and when the input it was rendered
+	// from was sampled.
+	struct RenderedFrame {
+		// Room for WIDTH * HEIGHT pixels, though only width * height are used.
+		std::vector<color3> pixels;
+		int width = WIDTH, height = HEIGHT, samples = SAMPLES;
+		// Which pixels are traced (the rest are filled in afterwards).
+		Interleave interleave;
+		std::chrono::steady_clock::time_point input_sampled_at;
+	};
+
+	// Move our Shapes and light according to some input.
+	void UpdateScene(const SceneInput& input) {
+		// Update the position of our first Circle every update.
+		// sin/cos = easy, cheap motion.
+		Shape& shape = *shapes.at(0);
+		vf3d previous_origin = shape.origin;
+		shape.origin.y = sinf(input.time) * 100 - 100;
+		shape.origin.z = cosf(input.time) * 100 + 100;
+
+		// Remember how far it moved, so we can follow it back into previous frames.
+		shape.motion = shape.origin - previous_origin;
+
+		// Update the position of our first Light relative to the mouse position.
+		Light& light = lights.at(0);
+		vf3d previous_light = light.origin;
+		light.origin.x = ((input.mouse_x / (float)WIDTH) - 0.5f) * 1000;
+		light.origin.y = ((input.mouse_y / (float)HEIGHT) - 0.5f) * 1000 - 700;
+
+		// Tell our shadow cache what moved, so it can forget the shadows that changed.
+		if (settings.shadow_cache) {
+			shadow_cache.BeginFrame();
+			for (auto& moved : shapes) {
+				if (moved->motion.x == 0 && moved->motion.y == 0 && moved->motion.z == 0)
+					continue;
+				// Shadows could change anywhere along where a Shape was, or is now.
+				if (std::optional<aabb> box = moved->bounds())
+					shadow_cache.Moved(box->merge(aabb(box->min - moved->motion, box->max - moved->motion)));
+				else
+					shadow_cache.MovedEverywhere();
+			}
+			if (light.origin.x != previous_light.x || light.origin.y != previous_light.y)
+				shadow_cache.LightMoved(0);
+		}
+
+		// Now that everything has moved, rebuild our acceleration structure.
+		BuildAcceleration();
+	}
+
+	// Render frames on their own thread, each from the newest input, until stopped.
+	void RenderLoop() {
+		while (RenderedFrame* back = pipeline->BeginFrame()) {
+			SceneInput input;
+			{
+				std::lock_guard lock(input_mutex);
+				input = latest_input;
+			}
+
+			RenderScene(input, *back);
+			pipeline->EndFrame(back);
+		}
+	}
+
+	// Move the scene to match some input, then render it at the resolution and
+	// sample count picked by our ResolutionController.
+	void RenderScene(const SceneInput& input, RenderedFrame& target) {
+		auto start = std::chrono::steady_clock::now();
+
+		UpdateScene(input);
+
+		target.width = resolution.width();
+		target.height = resolution.height();
+		target.samples = resolution.sample_count();
+		target.input_sampled_at = input.sampled_at;
+
+		// Fewer samples per pixel than usual get fewer shadow rays too, so soft
+		// shadows keep the same share of our frame budget. (Temporal accumulation
+		// always renders one sample, which is as many as it ever renders.)
+		shadow_rays = std::clamp(settings.shadow_rays * target.samples / resolution.max_sample_count(), 1, MAX_SHADOW_RAYS);
+
+		// Each frame traces the next set of interleaved pixels.
+		int pattern = input.interleave ? settings.interleave : 1;
+		target.interleave = { pattern, int(frame_count++ % pattern) };
+
+		// Render the scene with whichever kernel matches our settings.
+		(this->*SelectKernel(target.samples))(target);
+
+		// Fill in the pixels we skipped.
+		if (settings.interleave != 1)
+			ReconstructFrame(target);
+
+		// Add this frame's samples to everything rendered before it.
+		if (settings.progressive)
+			ProgressiveFrame(target);
+
+		// Blend in previous frames.
+		if (settings.temporal)
+			AccumulateFrame(target);
+
+		// Smooth out whatever noise is left.
+		if (settings.denoise)
+			DenoiseFrame(target);
+
+		// Save the frame while it still holds the full range of light.
+		if (!settings.hdr_output.empty())
+			SaveFrame(target);
+
+		// Finally, bring the frame into the range the screen can show.
+		if (settings.tonemap != Tonemap::Clamp || settings.exposure != 0)
+			TonemapFrame(target);
+
+		float frame_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		resolution.Update(frame_time);
+
+		// With path termination, report (and reset) how many rays each sample took,
+		// about once a second.
+		auto now = std::chrono::steady_clock::now();
+		if (settings.roulette && now - path_reported_at >= std::chrono::seconds(1)) {
+			fprintf(report, "Average path length: %.2f rays per sample\n", path_rays / (double)path_samples);
+			path_rays = path_samples = 0;
+			path_reported_at = now;
+		}
+	}
+
+	// Fill in the pixels of a frame that weren't traced, and keep a copy of the
+	// result to fill in the next frame from.
+	void ReconstructFrame(RenderedFrame& target) {
+		size_t count = target.width * target.height;
+		std::span<color3> pixels = std::span(target.pixels).first(count);
+
+		// The previous frame is no use if it was a different size.
+		if (previous_width != target.width || previous_height != target.height)
+			previous.clear();
+
+		if (target.interleave.pattern != 1)
+			ReconstructInterleaved(pixels, previous, target.width, target.height, target.interleave);
+
+		previous.assign(pixels.begin(), pixels.end());
+		previous_width = target.width;
+		previous_height = target.height;
+	}
+
+	// Add the pixels traced in a frame to the running average of every pixel, and
+	// replace them with it. Every checkpoint_every frames (once every pixel has
+	// been traced), save a checkpoint.
+	void ProgressiveFrame(RenderedFrame& target) {
+		size_t count = target.width * target.height;
+		if (progressive_width != target.width || progressive_height != target.height) {
+			progressive_sum.assign(count * 3, 0.0);
+			progressive_samples.assign(count, 0);
+			progressive_width = target.width;
+			progressive_height = target.height;
+		}
+
+		workers.ParallelFor(target.height, [&](int y) {
+			for (int x = 0; x < target.width; x++) {
+				size_t index = y * target.width + x;
+				color3& color = target.pixels[index];
+				double* sum = &progressive_sum[index * 3];
+
+				// Each traced pixel is already the average of target.samples samples.
+				if (target.interleave.traced(x, y)) {
+					sum[0] += double(color.x) * target.samples;
+					sum[1] += double(color.y) * target.samples;
+					sum[2] += double(color.z) * target.samples;
+					progressive_samples[index] += target.samples;
+				}
+
+				// Pixels that haven't been traced yet keep their reconstructed color.
+				if (uint32_t samples = progressive_samples[index])
+					color = color3(float(sum[0] / samples), float(sum[1] / samples), float(sum[2] / samples));
+			}
+		});
+
+		if (!settings.checkpoint.empty() && frame_count % settings.checkpoint_every == 0 && frame_count >= uint64_t(settings.interleave))
+			SaveCheckpoint();
+	}
+
+	// A hash of the settings that change how a progressive render is rendered, to
+	// make sure a checkpoint is continued with the same ones.
+	uint32_t SettingsHash() const {
+		char text[256];
+		int length = snprintf(text, sizeof(text), "%d %d %d %d %d %d %d %d %d %d %d", settings.bounces, settings.samples,
+			settings.fog, settings.shadows, settings.extra_lights, settings.light_samples, int(settings.light_type),
+			settings.shadow_rays, settings.roulette, settings.interleave, settings.sphere_field);
+
+		// FNV-1a
+		uint32_t hash = 2166136261u;
+		for (int i = 0; i < length; i++)
+			hash = (hash ^ uint8_t(text[i])) * 16777619u;
+		return hash;
+	}
+
+	// Save our progressive render, and everything else needed to carry on exactly
+	// where it left off, to our checkpoint file (in the background).
+	void SaveCheckpoint() {
+		std::ostringstream state;
+		state << sampler;
+		std::string sampler_state = state.str();
+
+		CheckpointHeader header;
+		header.settings_hash = SettingsHash();
+		header.width = progressive_width;
+		header.height = progressive_height;
+		header.frame_count = frame_count;
+		header.sampler_size = uint32_t(sampler_state.size());
+
+		std::vector<char> data;
+		data.reserve(sizeof(header) + sampler_state.size() + progressive_sum.size() * sizeof(double) + progressive_samples.size() * sizeof(uint32_t));
+		auto put = [&data](const void* bytes, size_t size) { data.insert(data.end(), (const char*)bytes, (const char*)bytes + size); };
+		put(&header, sizeof(header));
+		put(sampler_state.data(), sampler_state.size());
+		put(progressive_sum.data(), progressive_sum.size() * sizeof(double));
+		put(progressive_samples.data(), progressive_samples.size() * sizeof(uint32_t));
+
+		checkpoint_writer.Write(settings.checkpoint, std::move(data));
+	}
+
+	// Carry on the progressive render saved in our checkpoint file. Returns false
+	// (after saying why) if it can't be.
+	bool LoadCheckpoint() {
+		std::vector<char> data;
+		if (FILE* file = fopen(settings.checkpoint.c_str(), "rb")) {
+			char buffer[65536];
+			for (size_t read; (read = fread(buffer, 1, sizeof(buffer), file)) > 0;)
+				data.insert(data.end(), buffer, buffer + read);
+			fclose(file);
+		} else {
+			fprintf(stderr, "Couldn't open %s\n", settings.checkpoint.c_str());
+			return false;
+		}
+
+		// Check it's a whole checkpoint, of a render the size of our screen.
+		CheckpointHeader header, expected;
+		bool valid = data.size() >= sizeof(header);
+		if (valid)
+			memcpy(&header, data.data(), sizeof(header));
+		const size_t count = size_t(WIDTH) * HEIGHT;
+		valid = valid && memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 && header.version == expected.version
+			&& header.width == WIDTH && header.height == HEIGHT
+			&& data.size() == sizeof(header) + header.sampler_size + count * (3 * sizeof(double) + sizeof(uint32_t));
+		if (!valid) {
+			fprintf(stderr, "%s isn't a checkpoint of a %dx%d render\n", settings.checkpoint.c_str(), WIDTH, HEIGHT);
+			return false;
+		}
+		if (header.settings_hash != SettingsHash()) {
+			fprintf(stderr, "%s was rendered with different settings\n", settings.checkpoint.c_str());
+			return false;
+		}
+
+		const char* pos = data.data() + sizeof(header);
+		std::istringstream state(std::string(pos, header.sampler_size));
+		state >> sampler;
+		pos += header.sampler_size;
+
+		progressive_sum.resize(count * 3);
+		memcpy(progressive_sum.data(), pos, count * 3 * sizeof(double));
+		pos += count * 3 * sizeof(double);
+		progressive_samples.resize(count);
+		memcpy(progressive_samples.data(), pos, count * sizeof(uint32_t));
+		progressive_width = header.width;
+		progressive_height = header.height;
+
+		// Frames shown count towards --frames, so a resumed render stops where an
+		// uninterrupted one would.
+		frame_count = header.frame_count;
+		frames_shown = int(header.frame_count);
+		return true;
+	}
+
+	// Blend a newly rendered frame with the frames before it, replacing its pixels
+	// with the result.
+	void AccumulateFrame(RenderedFrame& target) {
+		size_t count = target.width * target.height;
+		std::span<color3> pixels = std::span(target.pixels).first(count);
+
+		// Without any (same sized) history, this frame starts a new one.
+		if (history_width != target.width || history_height != target.height) {
+			history.assign(pixels.begin(), pixels.end());
+			history_width = target.width;
+			history_height = target.height;
+			return;
+		}
+
+		motion.resize(count);
+		FindMotion(target, motion);
+
+		accumulated.resize(count);
+		TemporalAccumulate(pixels, motion, history, accumulated, target.width, target.height, TEMPORAL_BLEND);
+
+		// The result is both what we show, and the history for the next frame.
+		history.swap(accumulated);
+		std::copy(history.begin(), history.end(), pixels.begin());
+	}
+
+	// Denoise a rendered frame, guided by the surfaces seen through its pixels.
+	void DenoiseFrame(RenderedFrame& target) {
+		size_t count = target.width * target.height;
+		std::span<color3> pixels = std::span(target.pixels).first(count);
+
+		surfaces.resize(count);
+		workers.ParallelFor(target.height, [&](int y) {
+			FindSurfaces(target, y, std::span(surfaces).subspan(y * target.width, target.width));
+		});
+
+		denoised.resize(count);
+		DenoiseATrous(pixels, denoised, surfaces, target.width, target.height, workers);
+	}
+
+	// Write a rendered frame to our HDR output file, a block of rows at a time
+	// across our workers. Each block is written as soon as it's encoded.
+	void SaveFrame(const RenderedFrame& target) {
+		std::span<const color3> pixels = std::span(target.pixels).first(target.width * target.height);
+
+		std::string path = settings.hdr_output;
+		if (IsNumberedPath(path))
+			path = NumberedPath(path, hdr_frames_saved++);
+
+		HdrWriter writer;
+		if (!writer.Open(path, target.width, target.height, settings.hdr_half, settings.hdr_zip)) {
+			fprintf(stderr, "Couldn't open %s\n", path.c_str());
+			return;
+		}
+
+		workers.ParallelFor(writer.block_count(), [&](int block) {
+			int y = block * HdrWriter::BLOCK_ROWS;
+			int rows = std::min(HdrWriter::BLOCK_ROWS, target.height - y);
+			writer.WriteBlock(block, pixels.subspan(y * target.width, rows * target.width));
+		});
+
+		if (!writer.Close())
+			fprintf(stderr, "Couldn't write %s\n", path.c_str());
+	}
+
+	// Expose and tonemap a rendered frame, a row at a time across our workers.
+	void TonemapFrame(RenderedFrame& target) {
+		std::span<color3> pixels = std::span(target.pixels).first(target.width * target.height);
+		const float exposure = std::exp2(settings.exposure);
+
+		workers.ParallelFor(target.height, [&](int y) {
+			std::span<color3> row = pixels.subspan(y * target.width, target.width);
+			switch (settings.tonemap) {
+			case Tonemap::Reinhard: TonemapRow<Tonemap::Reinhard>(row, exposure); break;
+			case Tonemap::ACES: TonemapRow<Tonemap::ACES>(row, exposure); break;
+			default: TonemapRow<Tonemap::Clamp>(row, exposure); break;
+			}
+		});
+	}
+
+	// Find the surface seen through the center of each pixel in a row of a frame.
+	void FindSurfaces(const RenderedFrame& target, int y, std::span<SurfaceInfo> row) const {
+		const float pixel_width = WIDTH / (float)target.width;
+		const float pixel_height = HEIGHT / (float)target.height;
+
+		for (int x = 0; x < target.width; x++) {
+			SurfaceInfo& result = row[x];
+			result = {};
+
+			ray r = CameraRay((x + 0.5f) * pixel_width - HALF_WIDTH, (y + 0.5f) * pixel_height - HALF_HEIGHT);
+			float distance = INFINITY;
+			const Shape* shape = FindIntersection(r, distance);
+
+			// Anything hidden by the fog looks the same as seeing nothing.
+			if (shape == nullptr || (settings.fog && distance >= FOG_INTENSITY_INVERSE))
+				continue;
+
+			result.normal = shape->normal((r * distance).end()).direction;
+			result.depth = distance;
+			result.albedo = shape->sample(r);
+		}
+	}
+
+	// Find how far (in pixels) the surface seen through each pixel of a frame has
+	// moved since the last frame.
+	void FindMotion(const RenderedFrame& target, std::span<olc::vf2d> pixel_motion) const {
+		const float pixel_width = WIDTH / (float)target.width;
+		const float pixel_height = HEIGHT / (float)target.height;
+
+		for (int y = 0; y < target.height; y++) {
+			for (int x = 0; x < target.width; x++) {
+				olc::vf2d& result = pixel_motion[y * target.width + x];
+				result = { 0, 0 };
+
+				// Find the Shape seen through the center of this pixel.
+				olc::vf2d screen = { (x + 0.5f) * pixel_width - HALF_WIDTH, (y + 0.5f) * pixel_height - HALF_HEIGHT };
+				ray r = CameraRay(screen.x, screen.y);
+				float distance = INFINITY;
+				const Shape* shape = FindIntersection(r, distance);
+
+				// Things that didn't move (including the fog) have no motion.
+				if (shape == nullptr || (shape->motion.x == 0 && shape->motion.y == 0 && shape->motion.z == 0))
+					continue;
+
+				// Move the point we see back to where it was last frame, and find where
+				// that was on screen.
+				olc::vf2d previous = ProjectToScreen((r * distance).end() - shape->motion);
+				result = { (screen.x - previous.x) / pixel_width, (screen.y - previous.y) / pixel_height };
+			}
+		}
+	}
+
+	// Draw a rendered frame to the screen, and track how old its input is.
+	void Present(const RenderedFrame& rendered) {
+		// Frames rendered at a lower resolution are scaled up to fill the screen.
+		std::span<const color3> pixels = rendered.pixels;
+		if (rendered.width != WIDTH || rendered.height != HEIGHT) {
+			upscaled.resize(WIDTH * HEIGHT);
+			UpscaleBilinear(pixels, rendered.width, rendered.height, upscaled, WIDTH, HEIGHT);
+			pixels = upscaled;
+		}
+
+		// Each color3 is sizeof(color3) / sizeof(float) floats apart.
+		DrawTileF(0, 0, WIDTH, HEIGHT, &pixels[0].x, sizeof(color3) / sizeof(float), settings.gamma);
+
+		// Darken the frame towards its corners. Every pixel only depends on itself, so the
+		// engine can share the screen out between threads.
+		if (settings.vignette > 0) {
+			const float strength = settings.vignette / (HALF_WIDTH * HALF_WIDTH + HALF_HEIGHT * HALF_HEIGHT);
+			ApplyPixelKernel(0, 0, WIDTH, HEIGHT, [strength](int x, int y, olc::Pixel p) {
+				// Darken by the square of the distance from the center of the screen.
+				float dx = x + 0.5f - HALF_WIDTH, dy = y + 0.5f - HALF_HEIGHT;
+				return p * std::max(1 - strength * (dx * dx + dy * dy), 0.0f);
+			});
+		}
+
+		// Hand the finished screen to our recorder.
+		if (recorder)
+			recorder->Record(*GetDrawTarget());
+
+		if (!pipeline) return;
+
+		// Input latency is the time from sampling input to showing a frame rendered from it.
+		auto now = std::chrono::steady_clock::now();
+		float latency = std::chrono::duration<float, std::milli>(now - rendered.input_sampled_at).count();
+		latency_total += latency;
+		latency_max = std::max(latency_max, latency);
+		latency_frames++;
+
+		// Report (and reset) our statistics about once a second.
+		if (now - latency_reported_at >= std::chrono::seconds(1)) {
+			fprintf(report, "Input latency: %.1f ms average, %.1f ms max, over %d frames\n", latency_total / latency_frames, latency_max, latency_frames);
+			latency_total = latency_max = 0;
+			latency_frames = 0;
+			latency_reported_at = now;
+		}
+	}
+
+	// Render every pixel of the scene. Each combination of template arguments is
+	// compiled separately, so constant loop counts unroll and disabled features
+	// vanish entirely instead of being checked for every ray.
+	template <int SAMPLE_COUNT, int BOUNCE_COUNT, bool FOG_ENABLED, bool SHADOWS_ENABLED>
+	void RenderFrame(RenderedFrame& target) const {
+		const int sample_count = SAMPLE_COUNT == DYNAMIC ? target.samples : SAMPLE_COUNT;
+
+		// The size of a pixel of this frame, in screen pixels.
+		const float pixel_width = WIDTH / (float)target.width;
+		const float pixel_height = HEIGHT / (float)target.height;
+
+		// Iterate over the rows and (traced) columns of the scene
+		for (int y = 0; y < target.height; y++) {
+			for (int x = target.interleave.first(y, target.width); x < target.width; x += target.interleave.step()) {
+				// We'll be sampling this pixel multiple times with varying offsets to
+				// create a multisample, and then rendering the average of these samples.
+				color3 color(0.0f);
+
+				// For each sample...
+				for (auto i = 0; i < sample_count; i++) {
+					// Create random offset within this pixel
+					float offsetX = RandomUnit();
+					float offsetY = RandomUnit();
+
+					// Sample the color at that offset (converting frame coordinates to
+					// screen coordinates, and then to scene coordinates), and add it to our total.
+					color = color + Sample<BOUNCE_COUNT, FOG_ENABLED, SHADOWS_ENABLED>(
+						(x + offsetX) * pixel_width - HALF_WIDTH, (y + offsetY) * pixel_height - HALF_HEIGHT);
+				}
+
+				// Calculate the average color.
+				target.pixels[y * target.width + x] = color / sample_count;
+			}
+		}
+	}
+
+	template <int BOUNCE_COUNT, bool FOG_ENABLED, bool SHADOWS_ENABLED>
+	color3 Sample(float x, float y) const {
+		// Called to get the color of a specific point on the screen.
+
+		// Create a ray casting into the scene from this "pixel".
+		ray sample_ray = CameraRay(x, y);
+		path_samples++;
+
+		// Sample this ray - if the ray doesn't hit anything, use the color of
+		// the surrounding fog.
+		return SampleRay<BOUNCE_COUNT, FOG_ENABLED, SHADOWS_ENABLED>(sample_ray, settings.bounces).value_or(FOG);
+	}
+
+	// Create a (normalized) ray casting into the scene from a point on the screen
+	// (relative to its center).
+	ray CameraRay(float x, float y) const {
+		return ray({ 0, 0, -800 }, { (x / (float)WIDTH) * 100, (y / (float)HEIGHT) * 100, 200 }).normalize();
+	}
+
+	// Find the point on the screen (relative to its center) a point in the scene
+	// appears at - the opposite of CameraRay.
+	olc::vf2d ProjectToScreen(vf3d point) const {
+		vf3d direction = point - vf3d(0, 0, -800);
+		return { direction.x / direction.z * 2 * WIDTH, direction.y / direction.z * 2 * HEIGHT };
+	}
+
+	// A random number in [0, 1) from our sampler (using its top 24 bits, which a
+	// float holds exactly).
+	float RandomUnit() const {
+		return (sampler() >> 7) / float(1 << 24);
+	}
+
+	// Sample a ray that can still bounce some number of times. Its throughput is
+	// how much of its color will reach the pixel it's sampling (at most).
+	template <int BOUNCE_COUNT, bool FOG_ENABLED, bool SHADOWS_ENABLED>
+	std::optional<color3> SampleRay(const ray& r, int bounces, float throughput = 1.0f) const {
+		// A compile-time bounce count replaces the runtime one.
+		if constexpr (BOUNCE_COUNT != DYNAMIC)
+			bounces = BOUNCE_COUNT;
+		bounces--;
+		path_rays++;
+
+		// Called to get the color produced by a specific ray.
+
+		// This will be the color we (eventually) return/
+		color3 final_color;
+
+		// Store the distance along the ray that the intersection occurs.
+		float intersection_distance = INFINITY;
+
+		// Determine the Shape this ray intersects with (if any).
+		const Shape* intersected_shape_pointer = FindIntersection(r, intersection_distance);
+
+		// If we didn't intersect with any Shapes, return an empty optional.
+		if (intersected_shape_pointer == nullptr)
+			return {};
+
+		// Get the shape we discovered
+		const Shape &intersected_shape = *intersected_shape_pointer;
+
+		// Quick check - if the intersection is further away than the furthest Fog point,
+		// then we can save some time and not calculate anything further, since it would
+		// be obscured by Fog regardless.
+		if constexpr (FOG_ENABLED)
+			if (intersection_distance >= FOG_INTENSITY_INVERSE)
+				return FOG;
+
+		// Set our color to the sampled color of the Shape this ray with.
+		final_color = intersected_shape.sample(r);
+
+		// Determine the point at which our ray intersects our Shape.
+		vf3d intersection_point = (r * intersection_distance).end();
+		// Calculate the normal of the given Shape at that point.
+		ray normal = intersected_shape.normal(intersection_point);
+
+		// Apply reflection (kernels with a single bounce compile this out).
+		if constexpr (BOUNCE_COUNT != 1) {
+			const float reflectivity = intersected_shape.reflectivity;
+
+			// With path termination, faint reflections are only followed some of the time.
+			float survival = settings.roulette ? SurvivalChance(throughput * reflectivity) : 1.0f;
+
+			if (bounces != 0 && reflectivity > 0 && survival < 1 && RandomUnit() >= survival) {
+				// This path ends here, leaving only our Shape's own share of the color.
+				final_color = final_color * (1 - reflectivity);
+			} else if (bounces != 0 && reflectivity > 0) {
+				// Our reflection ray starts out as our normal...
+				ray reflection = normal;
+
+				// Apply a slight offset *along* the normal. This way our reflected ray will
+				// start at some slight offset from the surface so that rounding errors don't
+				// cause it to collide with the Shape it originated from!
+				reflection.origin = reflection.origin + (normal.direction + 0.001f);
+
+				// Reflect the direction around the normal with some simple geometry.
+				reflection.direction = (normal.direction * (2 * ((r.direction * -1) * normal.direction)) + r.direction).normalize();
+
+				// Recursion! Since SampleRay doesn't care if the ray is coming from the
+				// canvas, we can use it to get the color that will be reflected by this Shape!
+				constexpr int NEXT_BOUNCE_COUNT = BOUNCE_COUNT == DYNAMIC ? DYNAMIC : BOUNCE_COUNT - 1;
+				std::optional<color3> reflected_color = SampleRay<NEXT_BOUNCE_COUNT, FOG_ENABLED, SHADOWS_ENABLED>(reflection, bounces, throughput * reflectivity / survival);
+
+				// Finally, mix our Shape's color with the reflected color (or Fog color, in case
+				// of a miss) according to the reflectivity. Reflections that are only followed
+				// some of the time count for more when they are, so on average they add up
+				// to the same color.
+				if (survival == 1)
+					final_color = lerp(final_color, reflected_color.value_or(FOG), reflectivity);
+				else
+					final_color = final_color * (1 - reflectivity) + reflected_color.value_or(FOG) * (reflectivity / survival);
+			}
+		}
+
+		// Apply lighting
+
+		// Start with our ambient light, so no surfaces are entirely dark...
+		color3 light(AMBIENT_LIGHT);
+
+		// ...then add every Light that reaches this point.
+		ForEachLight(intersection_point, [&](const Light& source, float weight) {
+			// First we'll get the un-normalized ray from our intersection point to the light source.
+			ray light_ray = ray(intersection_point, source.origin - intersection_point);
+			// Get the distance to the light (equal to the length of the un-normalized ray).
+			float light_distance = light_ray.direction.length();
+			// Lights that don't reach this far don't need any more work.
+			if (light_distance >= source.radius)
+				return;
+			// We'll also offset the origin of the light ray by a small amount along the
+			// surface normal so the ray doesn't intersect with this Shape itself.
+			light_ray.origin = light_ray.origin + (normal.direction * 0.001f);
+			// And finally we'll normalize the light_ray.
+			light_ray.direction = light_ray.direction.normalize();
+
+			// Next we'll compute the dot product between our surface normal and the light ray.
+			// Surfaces pointing away from the light get none of it (and need no shadow ray).
+			float dot = light_ray.direction * normal.direction;
+			if (dot <= 0)
+				return;
+
+			// Then we'll search for any Shapes that is occluding the light_ray. We
+			// don't care if any of the Shapes intersect the ray beyond the light.
+			// Area lights can be partly hidden, which gives them soft shadows.
+			float visible = 1;
+			if constexpr (SHADOWS_ENABLED) {
+				visible = FindVisibility(source, light_ray, light_distance);
+				if (visible == 0)
+					return;
+			}
+
+			// Brighter, closer, more visible lights that we face more directly light us more.
+			light = light + source.color * (weight * visible * source.intensity * source.falloff(light_distance) * dot);
+		});
+
+		// Multiplying our final color by the light darkens surfaces that are in
+		// shadow, pointing away from, or far from our Lights, and brightens those
+		// lit by many. Light isn't limited here, so colors can go past 1: they're
+		// only squeezed into what the screen can show once the frame is finished
+		// (by TonemapFrame, or clamped as it's drawn).
+		final_color = color3(final_color.x * light.x, final_color.y * light.y, final_color.z * light.z);
+
+		// Apply Fog
+		if constexpr (FOG_ENABLED)
+			final_color = lerp(final_color, FOG, intersection_distance * FOG_INTENSITY);
+
+		return final_color;
+	}
+
+	// Find the nearest Shape along a ray (if any), storing the distance to it.
+	const Shape* FindIntersection(const ray& r, float& intersection_distance) const {
+		const Shape* intersected_shape = nullptr;
+
+		// Shapes that aren't in the grid (all of them, if we aren't using one)
+		// are checked one by one.
+		for (const Shape* shape : unbounded_shapes) {
+			// If the distance is not undefined (meaning no intersection)...
+			if (float distance = shape->intersection(r).value_or(INFINITY);
+					distance < intersection_distance) {
+				// Save the current Shape as the intersected Shape, and the distance
+				// along the ray that this intersection occurred.
+				intersected_shape = shape;
+				intersection_distance = distance;
+			}
+		}
+
+		if (acceleration == Acceleration::UniformGrid) {
+			// Walk the grid front-to-back, only checking the Shapes in each cell.
+			grid.Traverse(r, intersection_distance, [&](std::span<const uint32_t> cell, float cell_exit) {
+				for (uint32_t index : cell) {
+					if (float distance = grid_shapes[index]->intersection(r).value_or(INFINITY);
+							distance < intersection_distance) {
+						intersected_shape = grid_shapes[index];
+						intersection_distance = distance;
+					}
+				}
+
+				// Once we have a hit inside this cell, nothing in a later cell can be nearer.
+				return intersection_distance <= cell_exit;
+			});
+		}
+
+		return intersected_shape;
+	}
+
+	// Determine if any Shape intersects a ray closer than max_distance.
+	bool IsOccluded(const ray& r, float max_distance) const {
+		for (const Shape* shape : unbounded_shapes)
+			if (shape->intersection(r).value_or(INFINITY) < max_distance)
+				return true;
+
+		bool occluded = false;
+		if (acceleration == Acceleration::UniformGrid) {
+			grid.Traverse(r, max_distance, [&](std::span<const uint32_t> cell, float) {
+				for (uint32_t index : cell)
+					if (grid_shapes[index]->intersection(r).value_or(INFINITY) < max_distance)
+						return occluded = true;
+				return false;
+			});
+		}
+		return occluded;
+	}
+
+	// Determine how much of a Light can be seen along a (normalized) ray towards it:
+	// 0 or 1 for point lights, or anything in between for area lights. With our
+	// shadow cache, area lights reuse what we found before if nothing has changed.
+	// (A point light's single shadow ray is cheaper than looking it up.)
+	float FindVisibility(const Light& source, const ray& light_ray, float light_distance) const {
+		if (source.type == Light::Type::Point)
+			return !IsOccluded(light_ray, light_distance);
+		if (!settings.shadow_cache)
+			return Visibility(source, light_ray.origin);
+
+		const uint32_t index = uint32_t(&source - lights.data());
+		if (std::optional<float> cached = shadow_cache.Lookup(light_ray.origin, index, source.origin, source.extent(), ShadowCache::SAMPLES))
+			return *cached;
+		float visible = Visibility(source, light_ray.origin);
+		shadow_cache.Store(light_ray.origin, index, visible);
+		return visible;
+	}
+
+	// Determine which of a packet of (normalized) rays from the same origin are
+	// blocked by any Shape before their max_distances.
+	void FindOccluded(vf3d ray_origin, std::span<const vf3d> directions, std::span<const float> max_distances, std::span<bool> occluded) const {
+		// Test each Shape against the whole packet at once.
+		for (const Shape* shape : unbounded_shapes)
+			shape->occlusion(ray_origin, directions, max_distances, occluded);
+
+		// Rays take different paths through the grid, so walk it one at a time.
+		if (acceleration == Acceleration::UniformGrid) {
+			for (size_t i = 0; i < directions.size(); i++) {
+				if (occluded[i]) continue;
+				ray r(ray_origin, directions[i]);
+				grid.Traverse(r, max_distances[i], [&](std::span<const uint32_t> cell, float) {
+					for (uint32_t index : cell)
+						if (grid_shapes[index]->intersection(r).value_or(INFINITY) < max_distances[i])
+							return occluded[i] = true;
+					return false;
+				});
+			}
+		}
+	}
+
+	// Determine how much of an area light can be seen from a point (from 0 to 1),
+	// by casting shadow rays towards points spread over its surface. The surface is
+	// split into a grid of equal parts ("strata") with one ray towards each, so the
+	// rays can't all bunch up in one place. The whole grid of points is shifted by
+	// the same random offset (wrapping around), so each stratum still gets one ray.
+	float Visibility(const Light& source, vf3d from) const {
+		// Split our rays into as square a grid of strata as we can.
+		const int count = shadow_rays;
+		int rows = int(sqrtf(float(count)));
+		while (count % rows) rows--;
+		const int columns = count / rows;
+
+		std::array<olc::vf2d, MAX_SHADOW_RAYS> uvs;
+		float shift_u = RandomUnit(), shift_v = RandomUnit();
+		for (int i = 0; i < count; i++) {
+			float u = (i % columns + shift_u) / columns, v = (i / columns + shift_v) / rows;
+			uvs[i] = { u - floorf(u), v - floorf(v) };
+		}
+
+		// Find the rays towards those points...
+		std::array<vf3d, MAX_SHADOW_RAYS> directions;
+		std::array<float, MAX_SHADOW_RAYS> distances;
+		source.SamplePoints(from, std::span(uvs).first(count), std::span(directions).first(count));
+		for (int i = 0; i < count; i++) {
+			vf3d to_light = directions[i] - from;
+			distances[i] = to_light.length();
+			directions[i] = to_light / distances[i];
+		}
+
+		// ...and cast them all together.
+		std::array<bool, MAX_SHADOW_RAYS> occluded = {};
+		FindOccluded(from, std::span(directions).first(count), std::span(distances).first(count), std::span(occluded).first(count));
+		return std::count(occluded.begin(), occluded.begin() + count, false) / float(count);
+	}
+
+	// How likely we are to follow a reflection that adds some fraction of its color
+	// to a pixel: never if it's too faint to see, always if it's bright enough, and
+	// in proportion to its brightness in between.
+	static float SurvivalChance(float contribution) {
+		if (contribution < MIN_CONTRIBUTION)
+			return 0;
+		return std::min(contribution / ROULETTE_THRESHOLD, 1.0f);
+	}
+
+	// Call fn(light, weight) for every Light that might reach a point: those that
+	// reach everything, and those whose reach overlaps the point's cell of our light
+	// grid. With light sampling, only a few of the latter are picked at random, and
+	// weighted by 1 / (how likely they were to be picked) so that on average they
+	// add up to the same light as all of them. That only holds if nothing clips
+	// the light before it's averaged, which is why SampleRay leaves it unlimited.
+	template <typename F>
+	void ForEachLight(vf3d point, const F& fn) const {
+		for (const Light* light : unbounded_lights)
+			fn(*light, 1.0f);
+
+		int cell = light_grid.CellAt(point);
+		if (cell < 0) return;
+		std::span<const uint32_t> cell_lights = light_grid.CellItems(cell);
+
+		if (settings.light_samples == 0 || cell_lights.size() <= size_t(settings.light_samples)) {
+			for (uint32_t index : cell_lights)
+				fn(*grid_lights[index], 1.0f);
+			return;
+		}
+
+		for (int i = 0; i < settings.light_samples; i++) {
+			auto [picked, probability] = light_tables[cell].Sample(RandomUnit());
+			fn(*grid_lights[cell_lights[picked]], 1 / (settings.light_samples * probability));
+		}
+	}
+
+private:
+
+	// The settings we render with.
+	RenderSettings settings;
+
+	// Picks the resolution and sample count of each frame.
+	ResolutionController resolution;
+
+	// A render kernel specialized for some settings.
+	using RenderKernel = void (OlcPixelRayTracer::*)(RenderedFrame&) const;
+
+	// Build a table of kernels for every combination of KERNEL_SAMPLES, KERNEL_BOUNCES,
+	// fog and shadows. Index I is laid out as [samples][bounces][fog][shadows].
+	template <size_t... I>
+	static constexpr auto MakeKernels(std::index_sequence<I...>) {
+		return std::array<RenderKernel, sizeof...(I)> { &OlcPixelRayTracer::RenderFrame<
+			KERNEL_SAMPLES[I / (KERNEL_BOUNCES.size() * 4)],
+			KERNEL_BOUNCES[I / 4 % KERNEL_BOUNCES.size()],
+			(I & 2) != 0,
+			(I & 1) != 0>... };
+	}
+
+	// Choose the kernel that matches our settings and a sample count.
+	RenderKernel SelectKernel(int sample_count) const {
+		static constexpr auto kernels = MakeKernels(std::make_index_sequence<KERNEL_SAMPLES.size() * KERNEL_BOUNCES.size() * 4>());
+
+		auto samples = std::find(KERNEL_SAMPLES.begin(), KERNEL_SAMPLES.end(), sample_count);
+		auto bounces = std::find(KERNEL_BOUNCES.begin(), KERNEL_BOUNCES.end(), settings.bounces);
+		if (samples != KERNEL_SAMPLES.end() && bounces != KERNEL_BOUNCES.end()) {
+			size_t index = (samples - KERNEL_SAMPLES.begin()) * KERNEL_BOUNCES.size() + (bounces - KERNEL_BOUNCES.begin());
+			return kernels[index * 4 + settings.fog * 2 + settings.shadows];
+		}
+
+		// Counts we didn't specialize for are read at runtime. Fog and shadows
+		// are still compiled in or out.
+		static constexpr std::array<RenderKernel, 4> dynamic_kernels = {
+			&OlcPixelRayTracer::RenderFrame<DYNAMIC, DYNAMIC, false, false>,
+			&OlcPixelRayTracer::RenderFrame<DYNAMIC, DYNAMIC, false, true>,
+			&OlcPixelRayTracer::RenderFrame<DYNAMIC, DYNAMIC, true, false>,
+			&OlcPixelRayTracer::RenderFrame<DYNAMIC, DYNAMIC, true, true>,
+		};
+		return dynamic_kernels[settings.fog * 2 + settings.shadows];
+	}
+
+	// Time since we started, as of the latest frame.
+	float accumulated_time = 0.0f;
+
+	// How many frames the engine has shown.
+	int frames_shown = 0;
+
+	// How many numbered HDR files we've saved.
+	int hdr_frames_saved = 0;
+
+	// Where frames are recorded to, if anywhere.
+	std::unique_ptr<FrameRecorder> recorder;
+
+	// The frame we render into when we aren't pipelined.
+	RenderedFrame frame;
+
+	// Where frames rendered at a lower resolution are scaled up to.
+	std::vector<color3> upscaled;
+
+	// How many shadow rays to cast towards each area light this frame.
+	int shadow_rays = 1;
+
+	// The number of frames rendered so far, which picks the pixels to interleave.
+	uint64_t frame_count = 0;
+
+	// Whether interleaved rendering is on (if the settings ask for it).
+	bool interleave_enabled = true;
+
+	// The last frame rendered (and its size), to fill in skipped pixels from.
+	std::vector<color3> previous;
+	int previous_width = 0, previous_height = 0;
+
+	// With temporal accumulation, the accumulated image so far (and its size),
+	// the motion of each pixel of the latest frame, and space to blend them.
+	std::vector<color3> history, accumulated;
+	int history_width = 0, history_height = 0;
+	std::vector<olc::vf2d> motion;
+
+	// With progressive rendering, the sum of every sample of each pixel (red,
+	// green and blue), how many samples that is, and the size of the render.
+	std::vector<double> progressive_sum;
+	std::vector<uint32_t> progressive_samples;
+	int progressive_width = 0, progressive_height = 0;
+
+	// A checkpoint file starts with this, followed by the sampler's state (as
+	// text), then progressive_sum and progressive_samples. Its fields are ordered
+	// so there's no padding, which would be written out uninitialized.
+	struct CheckpointHeader {
+		char magic[4] = { 'R', 'T', 'C', 'P' };
+		uint32_t version = 2;
+		// Which settings the render was started with (see SettingsHash).
+		uint32_t settings_hash = 0;
+		int32_t width = 0, height = 0;
+		uint32_t sampler_size = 0;
+		// How many frames had been rendered.
+		uint64_t frame_count = 0;
+	};
+	static_assert(sizeof(CheckpointHeader) == 32, "CheckpointHeader mustn't have any padding");
+
+	// Writes our checkpoints, so rendering doesn't wait for them.
+	BackgroundWriter checkpoint_writer;
+
+	// When denoising, the surface seen through each pixel of the latest frame, and
+	// space to filter it in.
+	std::vector<SurfaceInfo> surfaces;
+	std::vector<color3> denoised;
+
+	// In pipelined mode, the frames being passed from our render thread to the
+	// engine thread, and the input passed back.
+	std::unique_ptr<FramePipeline<RenderedFrame>> pipeline;
+	std::thread render_thread;
+	std::mutex input_mutex;
+	SceneInput latest_input;
+
+	// Input latency statistics since we last reported them, and when that was.
+	float latency_total = 0, latency_max = 0;
+	int latency_frames = 0;
+	std::chrono::steady_clock::time_point latency_reported_at;
+
+	// Path length statistics since we last reported them: the rays traced and the
+	// samples they were traced for (counting changes them even while rendering,
+	// which is const), and when that was.
+	mutable uint64_t path_rays = 0, path_samples = 0;
+	std::chrono::steady_clock::time_point path_reported_at;
+
+	// Where all of our random numbers come from. A fixed seed renders the same
+	// frames every run, and its state is small enough to save in a checkpoint.
+	// Drawing numbers changes it even while rendering (which is const).
+	mutable std::minstd_rand sampler{ 1 };
+
+	// Where statistics are reported: stdout, unless we're recording video to it.
+	FILE* report = stdout;
+
+	// A vector of Shape smart pointers representing our scene.
+	// Because these are smart pointers we can point to subclasses of Shape.
+	std::vector<std::unique_ptr<Shape>> shapes;
+
+	// The acceleration used by this scene.
+	Acceleration acceleration = Acceleration::BruteForce;
+
+	// Threads used to build acceleration structures.
+	WorkerPool workers;
+
+	// The grid, the Shapes it indexes, and the Shapes it can't hold.
+	UniformGrid grid;
+	std::vector<const Shape*> grid_shapes;
+	std::vector<const Shape*> unbounded_shapes;
+
+	// The Lights in our scene.
+	std::vector<Light> lights;
+
+	// A grid of how far each Light reaches, the Lights it indexes, and the Lights
+	// that reach everywhere. Unlike Shapes, Lights always use a grid.
+	UniformGrid light_grid;
+	std::vector<const Light*> grid_lights;
+	std::vector<const Light*> unbounded_lights;
+
+	// With light sampling, a table for each cell of our light grid that picks its
+	// Lights in proportion to their brightness.
+	std::vector<AliasTable> light_tables;
+
+	// Remembers how visible our Lights are from points in the scene. Looking up
+	// shadows updates it, so it changes even while rendering (which is const).
+	mutable ShadowCache shadow_cache;
+
+	// Rebuild our acceleration structure after Shapes have moved.
+	void BuildAcceleration() {
+		grid_shapes.clear();
+		unbounded_shapes.clear();
+
+		std::vector<aabb> boxes;
+		for (auto& shape : shapes) {
+			// Only bounded Shapes can go in the grid, the rest are checked one by one.
+			std::optional<aabb> box = acceleration == Acceleration::UniformGrid ? shape->bounds() : std::nullopt;
+			if (box) {
+				grid_shapes.push_back(shape.get());
+				boxes.push_back(*box);
+			} else {
+				unbounded_shapes.push_back(shape.get());
+			}
+		}
+
+		grid.Build(boxes, workers);
+	}
+
+	// Build a grid of how far our Lights reach (and tables to sample them from).
+	void BuildLightGrid() {
+		grid_lights.clear();
+		unbounded_lights.clear();
+
+		std::vector<aabb> boxes;
+		for (const Light& light : lights) {
+			if (std::optional<aabb> box = light.bounds()) {
+				grid_lights.push_back(&light);
+				boxes.push_back(*box);
+			} else {
+				unbounded_lights.push_back(&light);
+			}
+		}
+
+		light_grid.Build(boxes, workers);
+
+		// Brighter Lights are picked more often when sampling.
+		if (settings.light_samples) {
+			light_tables.resize(light_grid.cell_count());
+			workers.ParallelFor(light_grid.cell_count(), [&](int cell) {
+				std::span<const uint32_t> cell_lights = light_grid.CellItems(cell);
+				light_tables[cell].Build(cell_lights.size(), [&](size_t i) {
+					const Light& light = *grid_lights[cell_lights[i]];
+					return light.intensity * (light.color.x + light.color.y + light.color.z);
+				});
+			});
+		}
+	}
+
+	// Apply a linear interpolation between two colors:
+	//  from |-------------------------------| to
+	//                ^ by
+	color3 lerp(color3 from, color3 to, float by) const {
 		if (by <= 0.0f) return from;
 		if (by >= 1.0f) return to;
 		return color3(
@@ -477,20 +3386,163 @@ private:
 			from.z * (1 - by) + to.z * by
 		);
 	}
-
-	// The position of our point light.
-	vf3d light_point;
 };
 
 /***** PROGRAM ENTRYPOINT *****/
 
-int main() {
+int main(int argc, char* argv[]) {
+	// Read our render settings from the command line.
+	RenderSettings settings;
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+		if ((arg == "--bounces" || arg == "--samples") && i + 1 < argc) {
+			int value = atoi(argv[++i]);
+			if (value < 1) {
+				fprintf(stderr, "%s must be at least 1\n", argv[i - 1]);
+				return 1;
+			}
+			(arg == "--bounces" ? settings.bounces : settings.samples) = value;
+		} else if (arg == "--pipeline" && i + 1 < argc) {
+			settings.pipeline_buffers = atoi(argv[++i]);
+			if (settings.pipeline_buffers != 2 && settings.pipeline_buffers != 3) {
+				fprintf(stderr, "--pipeline must be 2 or 3\n");
+				return 1;
+			}
+		} else if (arg == "--frame-budget" && i + 1 < argc) {
+			settings.frame_budget = (float)atof(argv[++i]);
+		} else if (arg == "--temporal") {
+			settings.temporal = true;
+		} else if (arg == "--interleave" && i + 1 < argc) {
+			settings.interleave = atoi(argv[++i]);
+			if (settings.interleave != 1 && settings.interleave != 2 && settings.interleave != 4) {
+				fprintf(stderr, "--interleave must be 1, 2 or 4\n");
+				return 1;
+			}
+		} else if (arg == "--denoise") {
+			settings.denoise = true;
+		} else if (arg == "--lights" && i + 1 < argc) {
+			settings.extra_lights = std::max(atoi(argv[++i]), 0);
+		} else if (arg == "--light-samples" && i + 1 < argc) {
+			settings.light_samples = std::max(atoi(argv[++i]), 0);
+		} else if (arg == "--area-light" && i + 1 < argc) {
+			std::string_view type = argv[++i];
+			if (type != "sphere" && type != "rectangle") {
+				fprintf(stderr, "--area-light must be sphere or rectangle\n");
+				return 1;
+			}
+			settings.light_type = type == "sphere" ? Light::Type::Sphere : Light::Type::Rectangle;
+		} else if (arg == "--spheres" && i + 1 < argc) {
+			settings.sphere_field = std::max(atoi(argv[++i]), 0);
+		} else if (arg == "--acceleration" && i + 1 < argc) {
+			std::string_view type = argv[++i];
+			if (type != "grid" && type != "brute") {
+				fprintf(stderr, "--acceleration must be grid or brute\n");
+				return 1;
+			}
+			settings.acceleration = type == "grid" ? Acceleration::UniformGrid : Acceleration::BruteForce;
+		} else if (arg == "--shadow-rays" && i + 1 < argc) {
+			settings.shadow_rays = std::clamp(atoi(argv[++i]), 1, MAX_SHADOW_RAYS);
+		} else if (arg == "--shadow-cache") {
+			settings.shadow_cache = true;
+		} else if (arg == "--roulette") {
+			settings.roulette = true;
+		} else if (arg == "--frames" && i + 1 < argc) {
+			settings.frames = std::max(atoi(argv[++i]), 0);
+		} else if (arg == "--timestep" && i + 1 < argc) {
+			settings.timestep = std::max((float)atof(argv[++i]), 0.0f);
+		} else if (arg == "--vignette" && i + 1 < argc) {
+			settings.vignette = std::clamp((float)atof(argv[++i]), 0.0f, 1.0f);
+		} else if (arg == "--tonemap" && i + 1 < argc) {
+			std::string_view curve = argv[++i];
+			if (curve != "clamp" && curve != "reinhard" && curve != "aces") {
+				fprintf(stderr, "--tonemap must be clamp, reinhard or aces\n");
+				return 1;
+			}
+			settings.tonemap = curve == "aces" ? Tonemap::ACES : curve == "reinhard" ? Tonemap::Reinhard : Tonemap::Clamp;
+		} else if (arg == "--exposure" && i + 1 < argc) {
+			settings.exposure = (float)atof(argv[++i]);
+		} else if (arg == "--gamma" && i + 1 < argc) {
+			settings.gamma = std::max((float)atof(argv[++i]), 0.1f);
+		} else if (arg == "--progressive") {
+			settings.progressive = true;
+		} else if (arg == "--checkpoint" && i + 1 < argc) {
+			settings.checkpoint = argv[++i];
+		} else if (arg == "--checkpoint-every" && i + 1 < argc) {
+			settings.checkpoint_every = std::max(atoi(argv[++i]), 1);
+		} else if (arg == "--resume") {
+			settings.resume = true;
+		} else if (arg == "--record" && i + 1 < argc) {
+			settings.record = argv[++i];
+			if (settings.record != "-" && !settings.record.ends_with(".y4m") && !IsNumberedPath(settings.record)) {
+				fprintf(stderr, "--record must be a .y4m file, - (for stdout), or numbered images like frame%%04d.ppm\n");
+				return 1;
+			}
+		} else if (arg == "--hdr-output" && i + 1 < argc) {
+			settings.hdr_output = argv[++i];
+		} else if (arg == "--hdr-half") {
+			settings.hdr_half = true;
+		} else if (arg == "--hdr-zip") {
+#if defined(EXR_ZIP)
+			settings.hdr_zip = true;
+#else
+			fprintf(stderr, "--hdr-zip needs a build with EXR_ZIP defined\n");
+			return 1;
+#endif
+		} else if (arg == "--no-fog") {
+			settings.fog = false;
+		} else if (arg == "--no-shadows") {
+			settings.shadows = false;
+		} else {
+			fprintf(stderr, "Usage: %s [--bounces N] [--samples N] [--no-fog] [--no-shadows] [--pipeline 2|3] [--frame-budget MS] [--temporal] [--interleave 1|2|4] [--denoise] [--lights N] [--light-samples N] [--area-light sphere|rectangle] [--spheres N] [--acceleration grid|brute] [--shadow-rays N] [--shadow-cache] [--roulette] [--frames N] [--timestep SECONDS] [--record FILE.y4m|-|FRAME%%04d.ppm] [--progressive] [--checkpoint FILE] [--checkpoint-every FRAMES] [--resume] [--vignette STRENGTH] [--tonemap clamp|reinhard|aces] [--exposure STOPS] [--gamma G] [--hdr-output FILE.pfm|FILE.exr] [--hdr-half] [--hdr-zip]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (settings.resume && settings.checkpoint.empty()) {
+		fprintf(stderr, "--resume needs a --checkpoint file\n");
+		return 1;
+	}
+
+	// Never write over a checkpoint we weren't asked to continue, in case it's
+	// hours of work.
+	if (!settings.checkpoint.empty() && !settings.resume && std::filesystem::exists(settings.checkpoint)) {
+		fprintf(stderr, "%s already exists: add --resume to continue it, or delete it to start again\n", settings.checkpoint.c_str());
+		return 1;
+	}
+
+	// Checkpoints are of progressive renders, which render every frame in full,
+	// and only carry their running average (and sampler) from one frame to the
+	// next, so that a checkpoint holds everything needed to carry on.
+	if (!settings.checkpoint.empty())
+		settings.progressive = true;
+	if (settings.progressive) {
+		settings.pipeline_buffers = 0;
+		settings.frame_budget = 0;
+		settings.temporal = false;
+		settings.shadow_cache = false;
+	}
+
+	// Recordings come out the same every run: time steps by a fixed amount (1/30th
+	// of a second, unless told otherwise), and every frame is rendered in full
+	// and shown, rather than depending on how long rendering takes.
+	if (!settings.record.empty()) {
+		if (settings.timestep == 0)
+			settings.timestep = 1 / 30.0f;
+		settings.pipeline_buffers = 0;
+		settings.frame_budget = 0;
+	}
+
 	// Create an instance of our PixelGameEngine
-	OlcPixelRayTracer ray_tracer;
+	OlcPixelRayTracer ray_tracer(settings);
+
+	// Step time by a fixed amount each frame, if asked, so runs can be repeated.
+	ray_tracer.SetFixedTimeStep(settings.timestep);
 
 	// Construct and start it with our WIDTH and HEIGHT constants.
-	if (ray_tracer.Construct(WIDTH, HEIGHT, 2, 2))
-		ray_tracer.Start();
+	if (!ray_tracer.Construct(WIDTH, HEIGHT, 2, 2) || ray_tracer.Start() != olc::OK)
+		return 1;
 
-	return 0;
+	// Fail if we never got going (say, a checkpoint couldn't be resumed), so
+	// scripts can tell that apart from a finished render.
+	return ray_tracer.created ? 0 : 1;
 }
@@ -282,6 +282,15 @@
 		  +Reintroduced sub-pixel decals
 		  +Modified DrawPartialDecal() to quantise and correctly sample from tile atlasses
 		  +olc::Sprite::GetPixel() - Clamp Mode
+		  +DrawRowF()/DrawTileF() - Batched floating point colour writes (SSE2 where available)
+		  +SetLayerDirtyTracking() - Layers can upload only the regions drawn to each frame
+		  +OLC_PLATFORM_HEADLESS - Runs without a display, compositing frames in software
+		  +SetFixedTimeStep() & SetFrameCaptureFunction() - For headless/offline rendering
+		  +ResourcePack v2 - Memory-mapped, hashed index, optionally scrambled files, zero-copy GetFileView()
+		  +Sprite::LoadFromFiles() - Loads a batch of images across several threads, timing each one
+		  +Sprite rows can be padded to 64 bytes - see Sprite::stride and Sprite::GetRow()
+		  +Clear(), FillRect() & unscaled DrawSprite() write whole rows at once in NORMAL & ALPHA modes
+		  +ApplyPixelKernel() - Runs a per-pixel function over part of the draw target on a persistent set of threads
 
 		  
     !! Apple Platforms will not see these updates immediately - Sorry, I dont have a mac to test... !!
@@ -354,12 +363,17 @@ int main()
 #include <list>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 #include <fstream>
 #include <map>
 #include <functional>
 #include <algorithm>
 #include <array>
 #include <cstring>
+#include <string_view>
+#include <new>
 #pragma endregion
 
 #define PGE_VER 217
@@ -405,7 +419,7 @@ int main()
 // O------------------------------------------------------------------------------O
 
 // Platform
-#if !defined(OLC_PLATFORM_WINAPI) && !defined(OLC_PLATFORM_X11) && !defined(OLC_PLATFORM_GLUT) && !defined(OLC_PLATFORM_EMSCRIPTEN)
+#if !defined(OLC_PLATFORM_WINAPI) && !defined(OLC_PLATFORM_X11) && !defined(OLC_PLATFORM_GLUT) && !defined(OLC_PLATFORM_EMSCRIPTEN) && !defined(OLC_PLATFORM_HEADLESS)
 	#if !defined(OLC_PLATFORM_CUSTOM_EX)
 		#if defined(_WIN32)
 			#define OLC_PLATFORM_WINAPI
@@ -429,10 +443,12 @@ int main()
 #endif
 
 // Renderer
-#if !defined(OLC_GFX_OPENGL10) && !defined(OLC_GFX_OPENGL33) && !defined(OLC_GFX_DIRECTX10)
+#if !defined(OLC_GFX_OPENGL10) && !defined(OLC_GFX_OPENGL33) && !defined(OLC_GFX_DIRECTX10) && !defined(OLC_GFX_SOFTWARE)
 	#if !defined(OLC_GFX_CUSTOM_EX)
 		#if defined(OLC_PLATFORM_EMSCRIPTEN)
 			#define OLC_GFX_OPENGL33
+		#elif defined(OLC_PLATFORM_HEADLESS)
+			#define OLC_GFX_SOFTWARE
 		#else
 			#define OLC_GFX_OPENGL10
 		#endif
@@ -452,6 +468,39 @@ int main()
 #endif
 
 
+// SIMD
+#if !defined(OLC_SIMD_SSE2) && !defined(OLC_SIMD_NONE)
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define OLC_SIMD_SSE2
+	#endif
+#endif
+
+#if defined(OLC_SIMD_SSE2)
+	#include <emmintrin.h>
+	#if defined(__SSSE3__) || defined(__AVX__)
+		#define OLC_SIMD_SSSE3
+		#include <tmmintrin.h>
+	#endif
+#endif
+
+// Resource packs are memory-mapped where possible, and read whole otherwise
+#if !defined(OLC_RESOURCEPACK_MMAP_POSIX) && !defined(OLC_RESOURCEPACK_MMAP_WIN32) && !defined(OLC_RESOURCEPACK_NO_MMAP)
+	#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)
+		#define OLC_RESOURCEPACK_MMAP_POSIX
+	#endif
+	#if defined(OLC_PLATFORM_WINAPI) && !defined(OLC_PLATFORM_HEADLESS) && !defined(OLC_PGE_HEADLESS)
+		#define OLC_RESOURCEPACK_MMAP_WIN32
+	#endif
+#endif
+
+#if defined(OLC_RESOURCEPACK_MMAP_POSIX)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+
 // O------------------------------------------------------------------------------O
 // | PLATFORM-SPECIFIC DEPENDENCIES                                               |
 // O------------------------------------------------------------------------------O
@@ -687,6 +736,11 @@ namespace olc
 	struct ResourceBuffer : public std::streambuf
 	{
 		ResourceBuffer(std::ifstream& ifs, uint32_t offset, uint32_t size);
+		// Read from memory - in place, or through a copy unscrambled with sKey
+		ResourceBuffer(const char* data, uint32_t size, const std::string& sKey = "");
+		// The file's contents (in vMemory, or straight from a memory-mapped pack)
+		const char* Data() const;
+		size_t Size() const;
 		std::vector<char> vMemory;
 	};
 
@@ -697,15 +751,34 @@ namespace olc
 		~ResourcePack();
 		bool AddFile(const std::string& sFile);
 		bool LoadPack(const std::string& sFile, const std::string& sKey);
-		bool SavePack(const std::string& sFile, const std::string& sKey);
+		// Files can be scrambled too, though then they can't be viewed in place
+		bool SavePack(const std::string& sFile, const std::string& sKey, bool bScrambleFiles = false);
 		ResourceBuffer GetFileBuffer(const std::string& sFile);
+		// The contents of an unscrambled file, straight from the pack (empty if missing or scrambled)
+		std::string_view GetFileView(const std::string& sFile) const;
 		bool Loaded();
 	private:
 		struct sResourceFile { uint32_t nSize; uint32_t nOffset; };
 		std::map<std::string, sResourceFile> mapFiles;
-		std::ifstream baseFile;
-		std::vector<char> scramble(const std::vector<char>& data, const std::string& key);
+
+		// A loaded pack, mapped into memory (or read into vPackData where that isn't possible)
+		struct sPackEntry { std::string_view sPath; uint32_t nSize; uint32_t nOffset; bool bScrambled; };
+		const char* pPackData = nullptr;
+		size_t nPackSize = 0;
+		bool bPackMapped = false;
+		std::vector<char> vPackData;
+		std::vector<char> vPackIndex;
+		std::vector<sPackEntry> vPackEntries;
+		std::vector<uint32_t> vPackHashes;
+		std::string sPackKey;
+		bool MapPack(const std::string& sFile);
+		void UnloadPack();
+		const sPackEntry* FindEntry(std::string_view sFile) const;
+
+		static void scramble(char* data, size_t size, const std::string& key);
+		static uint32_t hash(std::string_view s);
 		std::string makeposix(const std::string& path);
+		friend struct ResourceBuffer;
 	};
 
 
@@ -719,6 +792,21 @@ namespace olc
 	};
 
 
+	// Allocates memory aligned to nAlign bytes
+	template<typename T, size_t nAlign>
+	struct AlignedAllocator
+	{
+		typedef T value_type;
+		template<typename U> struct rebind { typedef AlignedAllocator<U, nAlign> other; };
+		AlignedAllocator() = default;
+		template<typename U> AlignedAllocator(const AlignedAllocator<U, nAlign>&) {}
+		T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(nAlign))); }
+		void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(nAlign)); }
+		template<typename U> bool operator==(const AlignedAllocator<U, nAlign>&) const { return true; }
+		template<typename U> bool operator!=(const AlignedAllocator<U, nAlign>&) const { return false; }
+	};
+
+
 	// O------------------------------------------------------------------------------O
 	// | olc::Sprite - An image represented by a 2D array of olc::Pixel               |
 	// O------------------------------------------------------------------------------O
@@ -728,15 +816,30 @@ namespace olc
 		Sprite();
 		Sprite(const std::string& sImageFile, olc::ResourcePack* pack = nullptr);
 		Sprite(int32_t w, int32_t h);
+		// With bAlignRows, every row starts on a 64 byte boundary (so threads writing
+		// neighbouring rows never share a cache line) and is padded out to stride pixels
+		Sprite(int32_t w, int32_t h, bool bAlignRows);
 		Sprite(const olc::Sprite&) = delete;
 		~Sprite();
 
 	public:
 		olc::rcode LoadFromFile(const std::string& sImageFile, olc::ResourcePack* pack = nullptr);
 
+		// One image in a batch given to LoadFromFiles()
+		struct LoadJob
+		{
+			olc::Sprite* sprite = nullptr;
+			std::string sImageFile;
+			olc::rcode result = olc::rcode::FAIL;
+			float fLoadTime = 0.0f; // Seconds spent reading and decoding this image
+		};
+		// Loads every image in the batch, nThreads at a time (0 = one per core)
+		static olc::rcode LoadFromFiles(std::vector<LoadJob>& vJobs, olc::ResourcePack* pack = nullptr, uint32_t nThreads = 0);
+
 	public:
 		int32_t width = 0;
 		int32_t height = 0;
+		int32_t stride = 0; // Pixels from the start of one row to the next
 		enum Mode { NORMAL, PERIODIC, CLAMP };
 		enum Flip { NONE = 0, HORIZ = 1, VERT = 2 };
 
@@ -749,9 +852,12 @@ namespace olc
 		Pixel Sample(float x, float y) const;
 		Pixel SampleBL(float u, float v) const;
 		Pixel* GetData();
+		// Row y of the sprite, without any checks - there are width pixels to the row
+		Pixel* GetRow(int32_t y);
+		const Pixel* GetRow(int32_t y) const;
 		olc::Sprite* Duplicate();
 		olc::Sprite* Duplicate(const olc::vi2d& vPos, const olc::vi2d& vSize);
-		std::vector<olc::Pixel> pColData;
+		std::vector<olc::Pixel, olc::AlignedAllocator<olc::Pixel, 64>> pColData;
 		Mode modeSample = Mode::NORMAL;
 
 		static std::unique_ptr<olc::ImageLoader> loader;
@@ -767,6 +873,7 @@ namespace olc
 		Decal(const uint32_t nExistingTextureResource, olc::Sprite* spr);
 		virtual ~Decal();
 		void Update();
+		void UpdateRegion(const olc::vi2d& pos, const olc::vi2d& size);
 		void UpdateSprite();
 
 	public: // But dont touch
@@ -836,6 +943,12 @@ namespace olc
 		olc::vf2d vScale = { 1, 1 };
 		bool bShow = false;
 		bool bUpdate = false;
+		bool bTrackDirty = false;
+		// Bounds (inclusive) of single pixels drawn since the last upload, empty when min > max
+		olc::vi2d vDirtyMin = { INT32_MAX, INT32_MAX };
+		olc::vi2d vDirtyMax = { INT32_MIN, INT32_MIN };
+		// Regions drawn since the last upload, as { position, size }
+		std::vector<std::pair<olc::vi2d, olc::vi2d>> vDirtyRects;
 		olc::Renderable pDrawTarget;
 		uint32_t nResID = 0;
 		std::vector<DecalInstance> vecDecalInstance;
@@ -857,6 +970,7 @@ namespace olc
 		virtual void       DrawDecal(const olc::DecalInstance& decal) = 0;
 		virtual uint32_t   CreateTexture(const uint32_t width, const uint32_t height, const bool filtered = false, const bool clamp = true) = 0;
 		virtual void       UpdateTexture(uint32_t id, olc::Sprite* spr) = 0;
+		virtual void       UpdateTextureRegion(uint32_t id, olc::Sprite* spr, const olc::vi2d& pos, const olc::vi2d& size) { UNUSED(pos); UNUSED(size); UpdateTexture(id, spr); }
 		virtual void       ReadTexture(uint32_t id, olc::Sprite* spr) = 0;
 		virtual uint32_t   DeleteTexture(const uint32_t id) = 0;
 		virtual void       ApplyTexture(uint32_t id) = 0;
@@ -883,6 +997,32 @@ namespace olc
 
 	class PGEX;
 
+	// O------------------------------------------------------------------------------O
+	// | olc::KernelThreads - Worker threads kept alive between ApplyPixelKernel calls|
+	// O------------------------------------------------------------------------------O
+	class KernelThreads
+	{
+	public:
+		KernelThreads(uint32_t nWorkers);
+		~KernelThreads();
+		// The number of threads that can share work, including the caller
+		uint32_t Size() const;
+		// Calls func(context) on nThreads threads (this one included) at once, returning
+		// when they've all finished
+		void Run(void (*func)(void*), void* context, uint32_t nThreads);
+
+	private:
+		void WorkerLoop();
+		std::vector<std::thread> vWorkers;
+		std::mutex muxRun, mux;
+		std::condition_variable cvWake, cvDone;
+		void (*pFunc)(void*) = nullptr;
+		void* pContext = nullptr;
+		uint64_t nGeneration = 0;
+		uint32_t nWanted = 0, nBusy = 0;
+		bool bStop = false;
+	};
+
 	// The Static Twins (plus one)
 	static std::unique_ptr<Renderer> renderer;
 	static std::unique_ptr<Platform> platform;
@@ -966,6 +1106,14 @@ namespace olc
 		void SetLayerScale(uint8_t layer, float x, float y);
 		void SetLayerTint(uint8_t layer, const olc::Pixel& tint);
 		void SetLayerCustomRenderFunction(uint8_t layer, std::function<void()> f);
+		// Only upload the regions of a layer drawn to since the last frame
+		void SetLayerDirtyTracking(uint8_t layer, bool b);
+		// Mark a region of a layer to be uploaded (drawing routines do this themselves)
+		void MarkLayerDirty(uint8_t layer, const olc::vi2d& pos, const olc::vi2d& size);
+		// Advance time by a fixed number of seconds each frame, instead of by the clock (0 = use the clock)
+		void SetFixedTimeStep(float fTimeStep);
+		// Called with each finished frame, where the renderer can provide them (see OLC_GFX_SOFTWARE)
+		void SetFrameCaptureFunction(std::function<void(const olc::Sprite& frame)> f);
 
 		std::vector<LayerDesc>& GetLayers();
 		uint32_t CreateLayer();
@@ -987,6 +1135,18 @@ namespace olc
 		// Draws a single Pixel
 		virtual bool Draw(int32_t x, int32_t y, Pixel p = olc::WHITE);
 		bool Draw(const olc::vi2d& pos, Pixel p = olc::WHITE);
+		// Draws a row of w floating point colours starting at (x,y). Each colour is at least
+		// three floats (r, g, b), with the next one nStride floats along. Channels are clamped
+		// to 0.0f - 1.0f, and a gamma curve of out = in ^ (1 / fGamma) is applied if fGamma != 1
+		bool DrawRowF(int32_t x, int32_t y, int32_t w, const float* pRGB, uint32_t nStride = 3, float fGamma = 1.0f);
+		// Draws a w * h tile of floating point colours, row by row, as DrawRowF()
+		bool DrawTileF(int32_t x, int32_t y, int32_t w, int32_t h, const float* pRGB, uint32_t nStride = 3, float fGamma = 1.0f);
+		// Replaces every pixel in a w * h area of the draw target with kernel(x, y, pixel),
+		// ignoring the pixel mode. Bands of rows are shared out between nThreads threads
+		// (0 = one per core, kept running between calls), so the kernel must be safe to
+		// call from several at once
+		template<typename Kernel>
+		void ApplyPixelKernel(int32_t x, int32_t y, int32_t w, int32_t h, Kernel kernel, uint32_t nThreads = 0);
 		// Draws a line from (x1,y1) to (x2,y2)
 		void DrawLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2, Pixel p = olc::WHITE, uint32_t pattern = 0xFFFFFFFF);
 		void DrawLine(const olc::vi2d& pos1, const olc::vi2d& pos2, Pixel p = olc::WHITE, uint32_t pattern = 0xFFFFFFFF);
@@ -1102,6 +1262,7 @@ namespace olc
 
 	private: // Inner mysterious workings
 		olc::Sprite*     pDrawTarget = nullptr;
+		std::unique_ptr<olc::KernelThreads> pKernelThreads;
 		Pixel::Mode	nPixelMode = Pixel::NORMAL;
 		float		fBlendFactor = 1.0f;
 		olc::vi2d	vScreenSize = { 256, 240 };
@@ -1134,7 +1295,21 @@ namespace olc
 		DecalStructure nDecalStructure = DecalStructure::FAN;
 		std::function<olc::Pixel(const int x, const int y, const olc::Pixel&, const olc::Pixel&)> funcPixelMode;
 		std::chrono::time_point<std::chrono::system_clock> m_tp1, m_tp2;
+		float		fFixedTimeStep = 0.0f;
+		std::function<void(const olc::Sprite&)> funcFrameCapture;
 		std::vector<olc::vi2d> vFontSpacing;
+		int32_t		nDirtyLayer = -1;
+		static constexpr size_t nMaxDirtyRects = 64;
+		static constexpr size_t nGammaTableSize = 4096;
+		std::vector<uint8_t> vGammaTable;
+		float		fGammaTable = 0.0f;
+		// Convert floating point colours to Pixels, used by DrawTileF()
+		static void ConvertPixelsF(const float* pRGB, uint32_t nStride, int32_t nCount, const uint8_t* pGamma, Pixel* pOut);
+		// Whole rows of pixels at once, used by Clear(), FillRect() and DrawSprite()
+		static void FillPixels(Pixel* pDest, int32_t nCount, Pixel p);
+		static void BlendPixels(Pixel* pDest, const Pixel* pSrc, int32_t nCount, float fBlend);
+		bool DrawSpriteRows(int32_t x, int32_t y, Sprite* sprite, int32_t ox, int32_t oy, int32_t w, int32_t h);
+		const uint8_t* GetGammaTable(float fGamma);
 
 		// State of keyboard		
 		bool		pKeyNewState[256] = { 0 };
@@ -1170,6 +1345,9 @@ namespace olc
 		void olc_Terminate();
 		void olc_Reanimate();
 		bool olc_IsRunning();
+		void olc_UpdateDirtyTarget();
+		void olc_UploadDirtyRegions(LayerDesc& layer);
+		void olc_CaptureFrame(const olc::Sprite& frame);
 
 		// At the very end of this file, chooses which
 		// components to compile
@@ -1207,6 +1385,53 @@ namespace olc
 	protected:
 		static PixelGameEngine* pge;
 	};
+
+
+	// O------------------------------------------------------------------------------O
+	// | olcPixelGameEngine TEMPLATE IMPLEMENTATION                                   |
+	// O------------------------------------------------------------------------------O
+	template<typename Kernel>
+	void PixelGameEngine::ApplyPixelKernel(int32_t x, int32_t y, int32_t w, int32_t h, Kernel kernel, uint32_t nThreads)
+	{
+		if (!pDrawTarget) return;
+
+		// Clip the area to the draw target
+		int32_t sx = std::max(x, 0), ex = std::min(x + w, pDrawTarget->width);
+		int32_t sy = std::max(y, 0), ey = std::min(y + h, pDrawTarget->height);
+		if (sx >= ex || sy >= ey) return;
+		if (nDirtyLayer >= 0) MarkLayerDirty(uint8_t(nDirtyLayer), { sx, sy }, { ex - sx, ey - sy });
+
+		// Threads take a band of rows at a time, so they only share cache lines where
+		// bands meet (and not even there, if the target's rows are aligned - see
+		// Sprite(w, h, bAlignRows)). Small areas aren't worth waking threads for
+		constexpr int32_t nBandRows = 16;
+		const int32_t nBands = (ey - sy + nBandRows - 1) / nBandRows;
+		if (nThreads == 0) nThreads = std::max(1u, std::thread::hardware_concurrency());
+		if (int64_t(ex - sx) * int64_t(ey - sy) < 16384) nThreads = 1;
+		nThreads = std::min(nThreads, uint32_t(nBands));
+
+		olc::Sprite* pTarget = pDrawTarget;
+		std::atomic<int32_t> nNextBand = 0;
+		auto Worker = [&]()
+		{
+			for (int32_t b = nNextBand++; b < nBands; b = nNextBand++)
+			{
+				const int32_t nEnd = std::min(ey, sy + (b + 1) * nBandRows);
+				for (int32_t j = sy + b * nBandRows; j < nEnd; j++)
+				{
+					olc::Pixel* pRow = pTarget->GetRow(j);
+					for (int32_t i = sx; i < ex; i++) pRow[i] = kernel(i, j, pRow[i]);
+				}
+			}
+		};
+
+		if (nThreads <= 1) { Worker(); return; }
+
+		// The threads are started on first use, then kept for every call after
+		if (!pKernelThreads)
+			pKernelThreads = std::make_unique<olc::KernelThreads>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		pKernelThreads->Run([](void* context) { (*static_cast<decltype(Worker)*>(context))(); }, &Worker, nThreads);
+	}
 }
 
 #pragma endregion
@@ -1334,11 +1559,19 @@ namespace olc
 
 	Sprite::Sprite(int32_t w, int32_t h)
 	{		
-		width = w;		height = h;
+		width = w;		height = h;		stride = w;
 		pColData.resize(width * height);
 		pColData.resize(width * height, nDefaultPixel);
 	}
 
+	Sprite::Sprite(int32_t w, int32_t h, bool bAlignRows)
+	{
+		// 16 pixels to a 64 byte cache line
+		width = w;		height = h;
+		stride = bAlignRows ? (w + 15) & ~15 : w;
+		pColData.resize(size_t(stride) * size_t(height), nDefaultPixel);
+	}
+
 	Sprite::~Sprite()
 	{ pColData.clear();	}
 
@@ -1356,16 +1589,16 @@ namespace olc
 		if (modeSample == olc::Sprite::Mode::NORMAL)
 		{
 			if (x >= 0 && x < width && y >= 0 && y < height)
-				return pColData[y * width + x];
+				return pColData[y * stride + x];
 			else
 				return Pixel(0, 0, 0, 0);
 		}
 		else
 		{
 			if (modeSample == olc::Sprite::Mode::PERIODIC)
-				return pColData[abs(y % height) * width + abs(x % width)];
+				return pColData[abs(y % height) * stride + abs(x % width)];
 			else
-				return pColData[std::max(0, std::min(y, height-1)) * width + std::max(0, std::min(x, width-1))];
+				return pColData[std::max(0, std::min(y, height-1)) * stride + std::max(0, std::min(x, width-1))];
 		}
 	}
 
@@ -1373,7 +1606,7 @@ namespace olc
 	{
 		if (x >= 0 && x < width && y >= 0 && y < height)
 		{
-			pColData[y * width + x] = p;
+			pColData[y * stride + x] = p;
 			return true;
 		}
 		else
@@ -1412,6 +1645,12 @@ namespace olc
 	Pixel* Sprite::GetData()
 	{ return pColData.data(); }
 
+	Pixel* Sprite::GetRow(int32_t y)
+	{ return pColData.data() + size_t(y) * stride; }
+
+	const Pixel* Sprite::GetRow(int32_t y) const
+	{ return pColData.data() + size_t(y) * stride; }
+
 
 	olc::rcode Sprite::LoadFromFile(const std::string& sImageFile, olc::ResourcePack* pack)
 	{
@@ -1419,10 +1658,40 @@ namespace olc
 		return loader->LoadImageResource(this, sImageFile, pack);
 	}
 
+	olc::rcode Sprite::LoadFromFiles(std::vector<LoadJob>& vJobs, olc::ResourcePack* pack, uint32_t nThreads)
+	{
+		if (nThreads == 0) nThreads = std::max(1u, std::thread::hardware_concurrency());
+		nThreads = std::min(nThreads, uint32_t(vJobs.size()));
+
+		// Each worker takes the next image until there are none left. The loaders keep no
+		// state of their own, and a loaded ResourcePack is only ever read from
+		std::atomic<size_t> nNextJob = 0;
+		auto Worker = [&]()
+		{
+			for (size_t i = nNextJob++; i < vJobs.size(); i = nNextJob++)
+			{
+				LoadJob& job = vJobs[i];
+				auto tp = std::chrono::steady_clock::now();
+				job.result = job.sprite->LoadFromFile(job.sImageFile, pack);
+				job.fLoadTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - tp).count();
+			}
+		};
+
+		// This thread does its share too
+		std::vector<std::thread> vWorkers;
+		for (uint32_t i = 1; i < nThreads; i++) vWorkers.emplace_back(Worker);
+		Worker();
+		for (auto& t : vWorkers) t.join();
+
+		for (auto& job : vJobs)
+			if (job.result != olc::rcode::OK) return job.result;
+		return olc::rcode::OK;
+	}
+
 	olc::Sprite* Sprite::Duplicate()
 	{
-		olc::Sprite* spr = new olc::Sprite(width, height);
-		std::memcpy(spr->GetData(), GetData(), width * height * sizeof(olc::Pixel));
+		olc::Sprite* spr = new olc::Sprite(width, height, stride != width);
+		std::memcpy(spr->GetData(), GetData(), pColData.size() * sizeof(olc::Pixel));
 		spr->modeSample = modeSample;
 		return spr;
 	}
@@ -1462,6 +1731,13 @@ namespace olc
 		renderer->UpdateTexture(id, sprite);
 	}
 
+	void Decal::UpdateRegion(const olc::vi2d& pos, const olc::vi2d& size)
+	{
+		if (sprite == nullptr) return;
+		renderer->ApplyTexture(id);
+		renderer->UpdateTextureRegion(id, sprite, pos, size);
+	}
+
 	void Decal::UpdateSprite()
 	{
 		if (sprite == nullptr) return;
@@ -1521,8 +1797,28 @@ namespace olc
 		setg(vMemory.data(), vMemory.data(), vMemory.data() + size);
 	}
 
+	ResourceBuffer::ResourceBuffer(const char* data, uint32_t size, const std::string& sKey)
+	{
+		if (data == nullptr) size = 0;
+		char* begin = const_cast<char*>(data);
+		if (!sKey.empty() && size > 0)
+		{
+			vMemory.assign(data, data + size);
+			ResourcePack::scramble(vMemory.data(), vMemory.size(), sKey);
+			begin = vMemory.data();
+		}
+		// The buffer is only ever read from, so it can point straight into the pack
+		setg(begin, begin, begin + size);
+	}
+
+	const char* ResourceBuffer::Data() const
+	{ return eback(); }
+
+	size_t ResourceBuffer::Size() const
+	{ return size_t(egptr() - eback()); }
+
 	ResourcePack::ResourcePack() { }
-	ResourcePack::~ResourcePack() { baseFile.close(); }
+	ResourcePack::~ResourcePack() { UnloadPack(); }
 
 	bool ResourcePack::AddFile(const std::string& sFile)
 	{
@@ -1541,138 +1837,304 @@ namespace olc
 
 	bool ResourcePack::LoadPack(const std::string& sFile, const std::string& sKey)
 	{
-		// Open the resource file
-		baseFile.open(sFile, std::ifstream::binary);
-		if (!baseFile.is_open()) return false;
+		// Map the resource file into memory
+		UnloadPack();
+		if (!MapPack(sFile)) return false;
+		sPackKey = sKey;
+
+		// 1) Read Scrambled index - version 2 packs start with a tag and version
+		size_t nHeaderSize = sizeof(uint32_t);
+		uint32_t nVersion = 1;
+		if (nPackSize >= 3 * sizeof(uint32_t) && memcmp(pPackData, "olcR", 4) == 0)
+		{
+			memcpy(&nVersion, pPackData + 4, sizeof(uint32_t));
+			nHeaderSize = 3 * sizeof(uint32_t);
+		}
 
-		// 1) Read Scrambled index
 		uint32_t nIndexSize = 0;
-		baseFile.read((char*)&nIndexSize, sizeof(uint32_t));
+		if (nPackSize < nHeaderSize) { UnloadPack(); return false; }
+		memcpy(&nIndexSize, pPackData + nHeaderSize - sizeof(uint32_t), sizeof(uint32_t));
+		if (nVersion > 2 || nIndexSize > nPackSize - nHeaderSize) { UnloadPack(); return false; }
 
-		std::vector<char> buffer(nIndexSize);
-		for (uint32_t j = 0; j < nIndexSize; j++)
-			buffer[j] = baseFile.get();
+		vPackIndex.assign(pPackData + nHeaderSize, pPackData + nHeaderSize + nIndexSize);
+		scramble(vPackIndex.data(), vPackIndex.size(), sKey);
 
-		std::vector<char> decoded = scramble(buffer, sKey);
 		size_t pos = 0;
-		auto read = [&decoded, &pos](char* dst, size_t size) {
-			memcpy((void*)dst, (const void*)(decoded.data() + pos), size);
+		auto read = [this, &pos](void* dst, size_t size) {
+			if (pos + size > vPackIndex.size()) return false;
+			memcpy(dst, vPackIndex.data() + pos, size);
 			pos += size;
+			return true;
 		};
 
-		auto get = [&read]() -> int { char c; read(&c, 1); return c; };
-
-		// 2) Read Map
+		// 2) Read Map - paths are left in the index, rather than copied out
 		uint32_t nMapEntries = 0;
-		read((char*)&nMapEntries, sizeof(uint32_t));
-		for (uint32_t i = 0; i < nMapEntries; i++)
+		bool bValid = read(&nMapEntries, sizeof(uint32_t));
+		for (uint32_t i = 0; bValid && i < nMapEntries; i++)
 		{
 			uint32_t nFilePathSize = 0;
-			read((char*)&nFilePathSize, sizeof(uint32_t));
+			bValid = read(&nFilePathSize, sizeof(uint32_t)) && pos + nFilePathSize <= vPackIndex.size();
+			if (!bValid) break;
 
-			std::string sFileName(nFilePathSize, ' ');
-			for (uint32_t j = 0; j < nFilePathSize; j++)
-				sFileName[j] = get();
+			sPackEntry e;
+			e.sPath = std::string_view(vPackIndex.data() + pos, nFilePathSize);
+			pos += nFilePathSize;
 
-			sResourceFile e;
-			read((char*)&e.nSize, sizeof(uint32_t));
-			read((char*)&e.nOffset, sizeof(uint32_t));
-			mapFiles[sFileName] = e;
+			uint32_t nFlags = 0;
+			bValid = read(&e.nSize, sizeof(uint32_t)) && read(&e.nOffset, sizeof(uint32_t))
+				&& (nVersion < 2 || read(&nFlags, sizeof(uint32_t)))
+				&& size_t(e.nOffset) + e.nSize <= nPackSize;
+			e.bScrambled = (nFlags & 1) != 0;
+			if (bValid) vPackEntries.push_back(e);
+		}
+		if (!bValid) { UnloadPack(); return false; }
+
+		// Loaded files are listed like added ones, as they always have been, so a later
+		// SavePack() includes them (reading them from their paths, like added files)
+		for (const auto& e : vPackEntries)
+			mapFiles[std::string(e.sPath)] = { e.nSize, e.nOffset };
+
+		// 3) Hash the paths (open addressing, at most half full) so lookups take constant time
+		size_t nTableSize = 16;
+		while (nTableSize < vPackEntries.size() * 2) nTableSize *= 2;
+		vPackHashes.assign(nTableSize, 0);
+		for (uint32_t i = 0; i < uint32_t(vPackEntries.size()); i++)
+		{
+			size_t slot = hash(vPackEntries[i].sPath) & (nTableSize - 1);
+			while (vPackHashes[slot] != 0) slot = (slot + 1) & (nTableSize - 1);
+			vPackHashes[slot] = i + 1;
 		}
 
-		// Don't close base file! we will provide a stream
-		// pointer when the file is requested
+		// Don't unmap the pack! Files are read straight out of it
 		return true;
 	}
 
-	bool ResourcePack::SavePack(const std::string& sFile, const std::string& sKey)
+	bool ResourcePack::MapPack(const std::string& sFile)
+	{
+#if defined(OLC_RESOURCEPACK_MMAP_POSIX)
+		int fd = ::open(sFile.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		void* pMapping = MAP_FAILED;
+		if (::fstat(fd, &st) == 0 && st.st_size > 0)
+			pMapping = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (pMapping != MAP_FAILED)
+		{
+			pPackData = (const char*)pMapping;
+			nPackSize = size_t(st.st_size);
+			bPackMapped = true;
+			return true;
+		}
+#endif
+
+#if defined(OLC_RESOURCEPACK_MMAP_WIN32)
+		HANDLE hFile = CreateFileA(sFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER nFileSize = {};
+		HANDLE hMapping = nullptr;
+		if (GetFileSizeEx(hFile, &nFileSize) && nFileSize.QuadPart > 0)
+			hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(hFile);
+		if (hMapping != nullptr)
+		{
+			// The view keeps the mapping alive
+			const void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(hMapping);
+			if (pView != nullptr)
+			{
+				pPackData = (const char*)pView;
+				nPackSize = size_t(nFileSize.QuadPart);
+				bPackMapped = true;
+				return true;
+			}
+		}
+#endif
+
+		// Otherwise read the whole pack in one go
+		std::ifstream ifs(sFile, std::ifstream::binary | std::ifstream::ate);
+		if (!ifs.is_open()) return false;
+		vPackData.resize(size_t(ifs.tellg()));
+		ifs.seekg(0);
+		ifs.read(vPackData.data(), vPackData.size());
+		pPackData = vPackData.data();
+		nPackSize = vPackData.size();
+		bPackMapped = false;
+		return true;
+	}
+
+	void ResourcePack::UnloadPack()
+	{
+		if (bPackMapped)
+		{
+#if defined(OLC_RESOURCEPACK_MMAP_POSIX)
+			::munmap((void*)pPackData, nPackSize);
+#endif
+#if defined(OLC_RESOURCEPACK_MMAP_WIN32)
+			UnmapViewOfFile(pPackData);
+#endif
+		}
+		pPackData = nullptr;
+		nPackSize = 0;
+		bPackMapped = false;
+		vPackData.clear();
+		vPackIndex.clear();
+		vPackEntries.clear();
+		vPackHashes.clear();
+		sPackKey.clear();
+	}
+
+	const ResourcePack::sPackEntry* ResourcePack::FindEntry(std::string_view sFile) const
+	{
+		if (vPackHashes.empty()) return nullptr;
+		const size_t nMask = vPackHashes.size() - 1;
+		for (size_t slot = hash(sFile) & nMask; vPackHashes[slot] != 0; slot = (slot + 1) & nMask)
+		{
+			const sPackEntry& e = vPackEntries[vPackHashes[slot] - 1];
+			if (e.sPath == sFile) return &e;
+		}
+		return nullptr;
+	}
+
+	bool ResourcePack::SavePack(const std::string& sFile, const std::string& sKey, bool bScrambleFiles)
 	{
 		// Create/Overwrite the resource file
 		std::ofstream ofs(sFile, std::ofstream::binary);
 		if (!ofs.is_open()) return false;
 
-		// Iterate through map
-		uint32_t nIndexSize = 0; // Unknown for now
-		ofs.write((char*)&nIndexSize, sizeof(uint32_t));
-		uint32_t nMapSize = uint32_t(mapFiles.size());
-		ofs.write((char*)&nMapSize, sizeof(uint32_t));
+		// 1) Work out where everything goes - each index entry has a known size (and
+		// mapFiles keeps them sorted by path), and files start on 16 byte boundaries
+		const uint32_t nFlags = (bScrambleFiles && !sKey.empty()) ? 1 : 0;
+		const uint32_t nHeaderSize = 3 * sizeof(uint32_t);
+		uint32_t nIndexSize = sizeof(uint32_t);
 		for (auto& e : mapFiles)
-		{
-			// Write the path of the file
-			size_t nPathSize = e.first.size();
-			ofs.write((char*)&nPathSize, sizeof(uint32_t));
-			ofs.write(e.first.c_str(), nPathSize);
+			nIndexSize += uint32_t(4 * sizeof(uint32_t) + e.first.size());
 
-			// Write the file entry properties
-			ofs.write((char*)&e.second.nSize, sizeof(uint32_t));
-			ofs.write((char*)&e.second.nOffset, sizeof(uint32_t));
-		}
-
-		// 2) Write the individual Data
-		std::streampos offset = ofs.tellp();
-		nIndexSize = (uint32_t)offset;
+		auto align = [](size_t n) { return (n + 15) & ~size_t(15); };
+		size_t offset = align(nHeaderSize + nIndexSize);
 		for (auto& e : mapFiles)
 		{
-			// Store beginning of file offset within resource pack file
-			e.second.nOffset = (uint32_t)offset;
-
-			// Load the file to be added
-			std::vector<uint8_t> vBuffer(e.second.nSize);
-			std::ifstream i(e.first, std::ifstream::binary);
-			i.read((char*)vBuffer.data(), e.second.nSize);
-			i.close();
-
-			// Write the loaded file into resource pack file
-			ofs.write((char*)vBuffer.data(), e.second.nSize);
-			offset += e.second.nSize;
+			e.second.nOffset = uint32_t(offset);
+			offset = align(offset + e.second.nSize);
 		}
 
-		// 3) Scramble Index
+		// 2) Scramble Index
 		std::vector<char> stream;
-		auto write = [&stream](const char* data, size_t size) {
+		auto write = [&stream](const void* data, size_t size) {
 			size_t sizeNow = stream.size();
 			stream.resize(sizeNow + size);
 			memcpy(stream.data() + sizeNow, data, size);
 		};
 
-		// Iterate through map
-		write((char*)&nMapSize, sizeof(uint32_t));
+		uint32_t nMapSize = uint32_t(mapFiles.size());
+		write(&nMapSize, sizeof(uint32_t));
 		for (auto& e : mapFiles)
 		{
 			// Write the path of the file
-			size_t nPathSize = e.first.size();
-			write((char*)&nPathSize, sizeof(uint32_t));
+			uint32_t nPathSize = uint32_t(e.first.size());
+			write(&nPathSize, sizeof(uint32_t));
 			write(e.first.c_str(), nPathSize);
 
 			// Write the file entry properties
-			write((char*)&e.second.nSize, sizeof(uint32_t));
-			write((char*)&e.second.nOffset, sizeof(uint32_t));
-		}
-		std::vector<char> sIndexString = scramble(stream, sKey);
-		uint32_t nIndexStringLen = uint32_t(sIndexString.size());
-		// 4) Rewrite Map (it has been updated with offsets now)
-		// at start of file
-		ofs.seekp(0, std::ios::beg);
-		ofs.write((char*)&nIndexStringLen, sizeof(uint32_t));
-		ofs.write(sIndexString.data(), nIndexStringLen);
+			write(&e.second.nSize, sizeof(uint32_t));
+			write(&e.second.nOffset, sizeof(uint32_t));
+			write(&nFlags, sizeof(uint32_t));
+		}
+		scramble(stream.data(), stream.size(), sKey);
+
+		// 3) Write the header (tag, version and index size) and index
+		const uint32_t nVersion = 2;
+		ofs.write("olcR", 4);
+		ofs.write((char*)&nVersion, sizeof(uint32_t));
+		ofs.write((char*)&nIndexSize, sizeof(uint32_t));
+		ofs.write(stream.data(), stream.size());
+
+		// 4) Write the individual Data, each padded out to its offset
+		size_t nWritten = nHeaderSize + stream.size();
+		std::vector<char> vBuffer;
+		for (auto& e : mapFiles)
+		{
+			vBuffer.assign(e.second.nOffset - nWritten, 0);
+			ofs.write(vBuffer.data(), vBuffer.size());
+
+			// Load the file to be added
+			vBuffer.resize(e.second.nSize);
+			std::ifstream i(e.first, std::ifstream::binary);
+			i.read(vBuffer.data(), e.second.nSize);
+			i.close();
+
+			// Write the loaded file into resource pack file
+			if (nFlags & 1) scramble(vBuffer.data(), vBuffer.size(), sKey);
+			ofs.write(vBuffer.data(), e.second.nSize);
+			nWritten = e.second.nOffset + e.second.nSize;
+		}
 		ofs.close();
 		return true;
 	}
 
 	ResourceBuffer ResourcePack::GetFileBuffer(const std::string& sFile)
-	{ return ResourceBuffer(baseFile, mapFiles[sFile].nOffset, mapFiles[sFile].nSize); }
+	{
+		const sPackEntry* e = FindEntry(sFile);
+		if (e == nullptr) return ResourceBuffer(nullptr, 0);
+		return ResourceBuffer(pPackData + e->nOffset, e->nSize, e->bScrambled ? sPackKey : std::string());
+	}
+
+	std::string_view ResourcePack::GetFileView(const std::string& sFile) const
+	{
+		const sPackEntry* e = FindEntry(sFile);
+		if (e == nullptr || e->bScrambled) return {};
+		return std::string_view(pPackData + e->nOffset, e->nSize);
+	}
 
 	bool ResourcePack::Loaded()
-	{ return baseFile.is_open(); }
+	{ return pPackData != nullptr; }
 
-	std::vector<char> ResourcePack::scramble(const std::vector<char>& data, const std::string& key)
+	void ResourcePack::scramble(char* data, size_t size, const std::string& key)
 	{
-		if (key.empty()) return data;
-		std::vector<char> o;
-		size_t c = 0;
-		for (auto s : data)	o.push_back(s ^ key[(c++) % key.size()]);
-		return o;
-	};
+		if (key.empty()) return;
+
+		// Repeat the key until it's a whole number of words long, so that each word of
+		// data lines up with a word of the pattern, then XOR a word at a time
+#if defined(OLC_SIMD_SSE2)
+		constexpr size_t nWord = sizeof(__m128i);
+#else
+		constexpr size_t nWord = sizeof(uint64_t);
+#endif
+		std::vector<char> vPattern(key.size() * nWord);
+		for (size_t i = 0; i < vPattern.size(); i++) vPattern[i] = key[i % key.size()];
+
+		size_t i = 0;
+		while (i + nWord <= size)
+		{
+			const size_t nRun = std::min(vPattern.size(), (size - i) / nWord * nWord);
+			for (size_t j = 0; j < nRun; j += nWord)
+			{
+#if defined(OLC_SIMD_SSE2)
+				const __m128i d = _mm_loadu_si128((const __m128i*)(data + i + j));
+				const __m128i k = _mm_loadu_si128((const __m128i*)(vPattern.data() + j));
+				_mm_storeu_si128((__m128i*)(data + i + j), _mm_xor_si128(d, k));
+#else
+				uint64_t d, k;
+				memcpy(&d, data + i + j, nWord);
+				memcpy(&k, vPattern.data() + j, nWord);
+				d ^= k;
+				memcpy(data + i + j, &d, nWord);
+#endif
+			}
+			i += nRun;
+		}
+
+		// Whatever's left is less than a word
+		for (; i < size; i++) data[i] ^= key[i % key.size()];
+	}
+
+	uint32_t ResourcePack::hash(std::string_view s)
+	{
+		// FNV-1a
+		uint32_t h = 2166136261u;
+		for (char c : s) h = (h ^ uint8_t(c)) * 16777619u;
+		return h;
+	}
 
 	std::string ResourcePack::makeposix(const std::string& path)
 	{
@@ -1681,6 +2143,67 @@ namespace olc
 		return o;
 	};
 
+	// O------------------------------------------------------------------------------O
+	// | olc::KernelThreads IMPLEMENTATION                                            |
+	// O------------------------------------------------------------------------------O
+	KernelThreads::KernelThreads(uint32_t nWorkers)
+	{
+		for (uint32_t i = 0; i < nWorkers; i++) vWorkers.emplace_back([this]() { WorkerLoop(); });
+	}
+
+	KernelThreads::~KernelThreads()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mux);
+			bStop = true;
+		}
+		cvWake.notify_all();
+		for (auto& t : vWorkers) t.join();
+	}
+
+	uint32_t KernelThreads::Size() const
+	{ return uint32_t(vWorkers.size()) + 1; }
+
+	void KernelThreads::Run(void (*func)(void*), void* context, uint32_t nThreads)
+	{
+		// One job at a time
+		std::lock_guard<std::mutex> lockRun(muxRun);
+		{
+			std::lock_guard<std::mutex> lock(mux);
+			pFunc = func; pContext = context;
+			nWanted = nBusy = std::min(nThreads, Size()) - 1;
+			nGeneration++;
+		}
+		cvWake.notify_all();
+
+		// This thread does its share too, then waits for the workers that joined in
+		func(context);
+		std::unique_lock<std::mutex> lock(mux);
+		cvDone.wait(lock, [this]() { return nBusy == 0; });
+	}
+
+	void KernelThreads::WorkerLoop()
+	{
+		uint64_t nSeen = 0;
+		while (true)
+		{
+			void (*func)(void*); void* context;
+			{
+				// Sleep until there's a new job that still wants more threads
+				std::unique_lock<std::mutex> lock(mux);
+				cvWake.wait(lock, [&]() { return bStop || (nGeneration != nSeen && nWanted > 0); });
+				if (bStop) return;
+				nSeen = nGeneration; nWanted--;
+				func = pFunc; context = pContext;
+			}
+
+			func(context);
+
+			std::lock_guard<std::mutex> lock(mux);
+			if (--nBusy == 0) cvDone.notify_all();
+		}
+	}
+
 	// O------------------------------------------------------------------------------O
 	// | olc::PixelGameEngine IMPLEMENTATION                                          |
 	// O------------------------------------------------------------------------------O
@@ -1767,6 +2290,7 @@ namespace olc
 			nTargetLayer = 0;
 			pDrawTarget = vLayers[0].pDrawTarget.Sprite();
 		}
+		olc_UpdateDirtyTarget();
 	}
 
 	void PixelGameEngine::SetDrawTarget(uint8_t layer)
@@ -1776,6 +2300,7 @@ namespace olc
 			pDrawTarget = vLayers[layer].pDrawTarget.Sprite();
 			vLayers[layer].bUpdate = true;
 			nTargetLayer = layer;
+			olc_UpdateDirtyTarget();
 		}
 	}
 
@@ -1800,6 +2325,69 @@ namespace olc
 	void PixelGameEngine::SetLayerCustomRenderFunction(uint8_t layer, std::function<void()> f)
 	{ if (layer < vLayers.size()) vLayers[layer].funcHook = f; }
 
+	void PixelGameEngine::SetFixedTimeStep(float fTimeStep)
+	{ fFixedTimeStep = std::max(fTimeStep, 0.0f); }
+
+	void PixelGameEngine::SetFrameCaptureFunction(std::function<void(const olc::Sprite& frame)> f)
+	{ funcFrameCapture = f; }
+
+	void PixelGameEngine::SetLayerDirtyTracking(uint8_t layer, bool b)
+	{
+		if (layer >= vLayers.size()) return;
+		vLayers[layer].bTrackDirty = b;
+		// Whatever was drawn before tracking started still needs uploading
+		if (b) MarkLayerDirty(layer, { 0, 0 }, vScreenSize);
+		olc_UpdateDirtyTarget();
+	}
+
+	void PixelGameEngine::MarkLayerDirty(uint8_t layer, const olc::vi2d& pos, const olc::vi2d& size)
+	{
+		if (layer >= vLayers.size() || size.x <= 0 || size.y <= 0) return;
+		vLayers[layer].vDirtyRects.push_back({ pos, size });
+		vLayers[layer].bUpdate = true;
+	}
+
+	void PixelGameEngine::olc_UpdateDirtyTarget()
+	{
+		// Drawing routines only need to record what they touch if they target a tracked layer
+		nDirtyLayer = -1;
+		for (size_t i = 0; i < vLayers.size(); i++)
+			if (vLayers[i].bTrackDirty && vLayers[i].pDrawTarget.Sprite() == pDrawTarget)
+				nDirtyLayer = int32_t(i);
+	}
+
+	void PixelGameEngine::olc_UploadDirtyRegions(LayerDesc& layer)
+	{
+		olc::Decal* decal = layer.pDrawTarget.Decal();
+		olc::Sprite* sprite = layer.pDrawTarget.Sprite();
+		const olc::vi2d vSize = { sprite->width, sprite->height };
+
+		// Single pixel writes become one more region
+		if (layer.vDirtyMin.x <= layer.vDirtyMax.x)
+			layer.vDirtyRects.push_back({ layer.vDirtyMin, layer.vDirtyMax - layer.vDirtyMin + olc::vi2d(1, 1) });
+		layer.vDirtyMin = { INT32_MAX, INT32_MAX };
+		layer.vDirtyMax = { INT32_MIN, INT32_MIN };
+
+		// Clip regions to the layer, totalling the area to upload
+		int64_t nArea = 0;
+		for (auto& [pos, size] : layer.vDirtyRects)
+		{
+			olc::vi2d tl = pos.max({ 0, 0 });
+			olc::vi2d br = (pos + size).min(vSize);
+			pos = tl; size = (br - tl).max({ 0, 0 });
+			nArea += int64_t(size.x) * size.y;
+		}
+
+		// Many regions, or most of the layer, is cheaper as a single upload
+		if (layer.vDirtyRects.size() > nMaxDirtyRects || nArea * 2 >= int64_t(vSize.x) * vSize.y)
+			decal->Update();
+		else
+			for (auto& [pos, size] : layer.vDirtyRects)
+				if (size.x > 0 && size.y > 0) decal->UpdateRegion(pos, size);
+
+		layer.vDirtyRects.clear();
+	}
+
 	std::vector<LayerDesc>& PixelGameEngine::GetLayers()
 	{ return vLayers; }
 
@@ -1883,6 +2471,13 @@ namespace olc
 	{
 		if (!pDrawTarget) return false;
 
+		if (nDirtyLayer >= 0)
+		{
+			LayerDesc& layer = vLayers[nDirtyLayer];
+			layer.vDirtyMin = layer.vDirtyMin.min({ x, y });
+			layer.vDirtyMax = layer.vDirtyMax.max({ x, y });
+		}
+
 		if (nPixelMode == Pixel::NORMAL)
 		{
 			return pDrawTarget->SetPixel(x, y, p);
@@ -1913,6 +2508,195 @@ namespace olc
 		return false;
 	}
 
+	void PixelGameEngine::FillPixels(Pixel* pDest, int32_t nCount, Pixel p)
+	{
+		int32_t i = 0;
+#if defined(OLC_SIMD_SSE2)
+		const __m128i m = _mm_set1_epi32(int32_t(p.n));
+		for (; i + 4 <= nCount; i += 4) _mm_storeu_si128((__m128i*)(pDest + i), m);
+#endif
+		for (; i < nCount; i++) pDest[i] = p;
+	}
+
+	void PixelGameEngine::BlendPixels(Pixel* pDest, const Pixel* pSrc, int32_t nCount, float fBlend)
+	{
+		// Exactly the sums Draw() does in ALPHA mode, a pixel per register
+		int32_t i = 0;
+#if defined(OLC_SIMD_SSE2)
+		const __m128 m255 = _mm_set1_ps(255.0f), mOne = _mm_set1_ps(1.0f), mBlend = _mm_set1_ps(fBlend);
+		const __m128i mZero = _mm_setzero_si128(), mAlpha = _mm_set1_epi32(int32_t(0xFF000000));
+		auto Widen = [&](__m128i v16, int32_t k) { return _mm_cvtepi32_ps(k ? _mm_unpackhi_epi16(v16, mZero) : _mm_unpacklo_epi16(v16, mZero)); };
+
+		for (; i + 4 <= nCount; i += 4)
+		{
+			const __m128i s = _mm_loadu_si128((const __m128i*)(pSrc + i));
+			const __m128i d = _mm_loadu_si128((const __m128i*)(pDest + i));
+			const __m128i s16[2] = { _mm_unpacklo_epi8(s, mZero), _mm_unpackhi_epi8(s, mZero) };
+			const __m128i d16[2] = { _mm_unpacklo_epi8(d, mZero), _mm_unpackhi_epi8(d, mZero) };
+
+			__m128i q[4];
+			for (int32_t k = 0; k < 4; k++)
+			{
+				const __m128 fs = Widen(s16[k >> 1], k & 1), fd = Widen(d16[k >> 1], k & 1);
+				const __m128 a = _mm_mul_ps(_mm_div_ps(_mm_shuffle_ps(fs, fs, _MM_SHUFFLE(3, 3, 3, 3)), m255), mBlend);
+				const __m128 c = _mm_sub_ps(mOne, a);
+				q[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(a, fs), _mm_mul_ps(c, fd)));
+			}
+
+			// The blended pixel is always opaque
+			const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+			_mm_storeu_si128((__m128i*)(pDest + i), _mm_or_si128(bytes, mAlpha));
+		}
+#endif
+		for (; i < nCount; i++)
+		{
+			const Pixel p = pSrc[i], d = pDest[i];
+			float a = (float)(p.a / 255.0f) * fBlend;
+			float c = 1.0f - a;
+			pDest[i] = Pixel((uint8_t)(a * (float)p.r + c * (float)d.r), (uint8_t)(a * (float)p.g + c * (float)d.g), (uint8_t)(a * (float)p.b + c * (float)d.b));
+		}
+	}
+
+	bool PixelGameEngine::DrawSpriteRows(int32_t x, int32_t y, Sprite* sprite, int32_t ox, int32_t oy, int32_t w, int32_t h)
+	{
+		// Only for NORMAL and ALPHA modes, and only when every pixel comes from inside the
+		// sprite (so its sample mode doesn't matter) - otherwise the caller draws pixel by pixel
+		if (!pDrawTarget || sprite == pDrawTarget || (nPixelMode != Pixel::NORMAL && nPixelMode != Pixel::ALPHA)) return false;
+		if (ox < 0 || oy < 0 || ox + w > sprite->width || oy + h > sprite->height) return false;
+
+		// Clip to the draw target
+		int32_t sx = std::max(x, 0), ex = std::min(x + w, pDrawTarget->width);
+		int32_t sy = std::max(y, 0), ey = std::min(y + h, pDrawTarget->height);
+		if (sx >= ex || sy >= ey) return true;
+		if (nDirtyLayer >= 0) MarkLayerDirty(uint8_t(nDirtyLayer), { sx, sy }, { ex - sx, ey - sy });
+
+		for (int32_t j = sy; j < ey; j++)
+		{
+			const Pixel* pSrc = sprite->GetRow(oy + j - y) + ox + (sx - x);
+			Pixel* pDest = pDrawTarget->GetRow(j) + sx;
+			if (nPixelMode == Pixel::NORMAL)
+				std::memcpy(pDest, pSrc, size_t(ex - sx) * sizeof(Pixel));
+			else
+				BlendPixels(pDest, pSrc, ex - sx, fBlendFactor);
+		}
+		return true;
+	}
+
+	bool PixelGameEngine::DrawRowF(int32_t x, int32_t y, int32_t w, const float* pRGB, uint32_t nStride, float fGamma)
+	{ return DrawTileF(x, y, w, 1, pRGB, nStride, fGamma); }
+
+	bool PixelGameEngine::DrawTileF(int32_t x, int32_t y, int32_t w, int32_t h, const float* pRGB, uint32_t nStride, float fGamma)
+	{
+		if (!pDrawTarget || !pRGB || nStride < 3 || fGamma <= 0.0f) return false;
+
+		// Clip the tile to the draw target
+		int32_t sx = std::max(x, 0), ex = std::min(x + w, pDrawTarget->width);
+		int32_t sy = std::max(y, 0), ey = std::min(y + h, pDrawTarget->height);
+		if (sx >= ex || sy >= ey) return false;
+
+		const uint8_t* pGamma = fGamma != 1.0f ? GetGammaTable(fGamma) : nullptr;
+		if (nDirtyLayer >= 0) MarkLayerDirty(uint8_t(nDirtyLayer), { sx, sy }, { ex - sx, ey - sy });
+
+		for (int32_t j = sy; j < ey; j++)
+		{
+			const float* pRow = pRGB + (size_t(j - y) * w + (sx - x)) * nStride;
+
+			// In NORMAL mode pixels are written straight into the draw target...
+			if (nPixelMode == Pixel::NORMAL)
+			{
+				ConvertPixelsF(pRow, nStride, ex - sx, pGamma, pDrawTarget->GetRow(j) + sx);
+				continue;
+			}
+
+			// ...otherwise they are converted in batches, then blended by Draw()
+			std::array<Pixel, 256> batch;
+			for (int32_t i = sx; i < ex; i += int32_t(batch.size()))
+			{
+				int32_t n = std::min(ex - i, int32_t(batch.size()));
+				ConvertPixelsF(pRow + size_t(i - sx) * nStride, nStride, n, pGamma, batch.data());
+				for (int32_t k = 0; k < n; k++) Draw(i + k, j, batch[k]);
+			}
+		}
+		return true;
+	}
+
+	void PixelGameEngine::ConvertPixelsF(const float* pRGB, uint32_t nStride, int32_t nCount, const uint8_t* pGamma, Pixel* pOut)
+	{
+		// Channels are clamped to 0-1, then truncated to 0-255 like olc::PixelF(),
+		// or rounded to the nearest entry in the gamma table
+		const float fScale = pGamma ? float(nGammaTableSize - 1) : 255.0f;
+		const float fBias = pGamma ? 0.5f : 0.0f;
+		int32_t i = 0;
+
+#if defined(OLC_SIMD_SSE2)
+		// Four pixels (12 or 16 floats) at a time. NaNs clamp to 0
+		const __m128 mZero = _mm_setzero_ps(), mOne = _mm_set1_ps(1.0f), mScale = _mm_set1_ps(fScale), mBias = _mm_set1_ps(fBias);
+		const __m128i mAlpha = _mm_set1_epi32(int32_t(0xFF000000));
+		auto Quantise = [&](const float* p) { return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), mZero), mOne), mScale), mBias)); };
+
+		if (nStride == 3 || nStride == 4)
+		{
+			for (; i + 4 <= nCount; i += 4)
+			{
+				const float* p = pRGB + size_t(i) * nStride;
+				__m128i q0 = Quantise(p), q1 = Quantise(p + 4), q2 = Quantise(p + 8);
+				__m128i q3 = nStride == 4 ? Quantise(p + 12) : _mm_setzero_si128();
+
+				if (pGamma)
+				{
+					alignas(16) int32_t idx[16];
+					_mm_store_si128((__m128i*)idx, q0); _mm_store_si128((__m128i*)(idx + 4), q1);
+					_mm_store_si128((__m128i*)(idx + 8), q2); _mm_store_si128((__m128i*)(idx + 12), q3);
+					for (int32_t k = 0; k < 4; k++)
+					{
+						const int32_t* c = idx + k * nStride;
+						pOut[i + k] = Pixel(pGamma[c[0]], pGamma[c[1]], pGamma[c[2]]);
+					}
+					continue;
+				}
+
+				// Bytes are now r, g, b(, w) repeated for each pixel
+				__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3));
+				if (nStride == 3)
+				{
+#if defined(OLC_SIMD_SSSE3)
+					// Spread r, g, b triples out to 4 bytes each (byte 12 is always zero)
+					bytes = _mm_shuffle_epi8(bytes, _mm_setr_epi8(0, 1, 2, 12, 3, 4, 5, 12, 6, 7, 8, 12, 9, 10, 11, 12));
+#else
+					alignas(16) uint8_t b[16];
+					_mm_store_si128((__m128i*)b, bytes);
+					for (int32_t k = 0; k < 4; k++) pOut[i + k] = Pixel(b[k * 3], b[k * 3 + 1], b[k * 3 + 2]);
+					continue;
+#endif
+				}
+				_mm_storeu_si128((__m128i*)(pOut + i), _mm_or_si128(bytes, mAlpha));
+			}
+		}
+#endif
+
+		auto Quantise1 = [&](float f) { return int32_t(std::min(1.0f, std::max(0.0f, f)) * fScale + fBias); };
+		for (const float* p = pRGB + size_t(i) * nStride; i < nCount; i++, p += nStride)
+		{
+			if (pGamma)
+				pOut[i] = Pixel(pGamma[Quantise1(p[0])], pGamma[Quantise1(p[1])], pGamma[Quantise1(p[2])]);
+			else
+				pOut[i] = Pixel(uint8_t(Quantise1(p[0])), uint8_t(Quantise1(p[1])), uint8_t(Quantise1(p[2])));
+		}
+	}
+
+	const uint8_t* PixelGameEngine::GetGammaTable(float fGamma)
+	{
+		// Rebuilt only when a different gamma is requested
+		if (fGamma != fGammaTable)
+		{
+			vGammaTable.resize(nGammaTableSize);
+			for (size_t i = 0; i < nGammaTableSize; i++)
+				vGammaTable[i] = uint8_t(std::pow(float(i) / float(nGammaTableSize - 1), 1.0f / fGamma) * 255.0f + 0.5f);
+			fGammaTable = fGamma;
+		}
+		return vGammaTable.data();
+	}
+
 
 	void PixelGameEngine::DrawLine(const olc::vi2d& pos1, const olc::vi2d& pos2, Pixel p, uint32_t pattern)
 	{ DrawLine(pos1.x, pos1.y, pos2.x, pos2.y, p, pattern); }
@@ -2096,9 +2880,8 @@ namespace olc
 
 	void PixelGameEngine::Clear(Pixel p)
 	{
-		int pixels = GetDrawTargetWidth() * GetDrawTargetHeight();
-		Pixel* m = GetDrawTarget()->GetData();
-		for (int i = 0; i < pixels; i++) m[i] = p;
+		FillPixels(GetDrawTarget()->GetData(), int32_t(GetDrawTarget()->pColData.size()), p);
+		if (nDirtyLayer >= 0) MarkLayerDirty(uint8_t(nDirtyLayer), { 0, 0 }, { GetDrawTargetWidth(), GetDrawTargetHeight() });
 	}
 
 	void PixelGameEngine::ClearBuffer(Pixel p, bool bDepth)
@@ -2159,6 +2942,26 @@ namespace olc
 		if (y2 < 0) y2 = 0;
 		if (y2 >= (int32_t)GetDrawTargetHeight()) y2 = (int32_t)GetDrawTargetHeight();
 
+		// NORMAL and ALPHA modes fill a row at a time
+		if (pDrawTarget && (nPixelMode == Pixel::NORMAL || nPixelMode == Pixel::ALPHA))
+		{
+			if (x >= x2 || y >= y2) return;
+			if (nDirtyLayer >= 0) MarkLayerDirty(uint8_t(nDirtyLayer), { x, y }, { x2 - x, y2 - y });
+
+			std::array<Pixel, 64> batch;
+			batch.fill(p);
+			for (int j = y; j < y2; j++)
+			{
+				Pixel* pDest = pDrawTarget->GetRow(j);
+				if (nPixelMode == Pixel::NORMAL)
+					FillPixels(pDest + x, x2 - x, p);
+				else
+					for (int i = x; i < x2; i += int(batch.size()))
+						BlendPixels(pDest + i, batch.data(), std::min(x2 - i, int(batch.size())), fBlendFactor);
+			}
+			return;
+		}
+
 		for (int i = x; i < x2; i++)
 			for (int j = y; j < y2; j++)
 				Draw(i, j, p);
@@ -2321,6 +3124,9 @@ namespace olc
 		if (sprite == nullptr)
 			return;
 
+		if (scale == 1 && flip == olc::Sprite::Flip::NONE && DrawSpriteRows(x, y, sprite, 0, 0, sprite->width, sprite->height))
+			return;
+
 		int32_t fxs = 0, fxm = 1, fx = 0;
 		int32_t fys = 0, fym = 1, fy = 0;
 		if (flip & olc::Sprite::Flip::HORIZ) { fxs = sprite->width - 1; fxm = -1; }
@@ -2358,6 +3164,9 @@ namespace olc
 		if (sprite == nullptr)
 			return;
 
+		if (scale == 1 && flip == olc::Sprite::Flip::NONE && DrawSpriteRows(x, y, sprite, ox, oy, w, h))
+			return;
+
 		int32_t fxs = 0, fxm = 1, fx = 0;
 		int32_t fys = 0, fym = 1, fy = 0;
 		if (flip & olc::Sprite::Flip::HORIZ) { fxs = w - 1; fxm = -1; }
@@ -3090,6 +3899,9 @@ namespace olc
 	void PixelGameEngine::olc_Terminate()
 	{ bAtomActive = false; }
 
+	void PixelGameEngine::olc_CaptureFrame(const olc::Sprite& frame)
+	{ if (funcFrameCapture) funcFrameCapture(frame); }
+
 	void PixelGameEngine::EngineThread()
 	{
 		// Allow platform to do stuff here if needed, since its now in the
@@ -3146,8 +3958,8 @@ namespace olc
 		std::chrono::duration<float> elapsedTime = m_tp2 - m_tp1;
 		m_tp1 = m_tp2;
 
-		// Our time per frame coefficient
-		float fElapsedTime = elapsedTime.count();
+		// Our time per frame coefficient (or a fixed step, for reproducible output)
+		float fElapsedTime = fFixedTimeStep > 0.0f ? fFixedTimeStep : elapsedTime.count();
 		fLastElapsed = fElapsedTime;
 
 		// Some platforms will need to check for events
@@ -3215,7 +4027,10 @@ namespace olc
 					renderer->ApplyTexture(layer->pDrawTarget.Decal()->id);
 					if (layer->bUpdate)
 					{
-						layer->pDrawTarget.Decal()->Update();
+						if (layer->bTrackDirty)
+							olc_UploadDirtyRegions(*layer);
+						else
+							layer->pDrawTarget.Decal()->Update();
 						layer->bUpdate = false;
 					}
 
@@ -3690,12 +4505,24 @@ namespace olc
 		void UpdateTexture(uint32_t id, olc::Sprite* spr) override
 		{
 			UNUSED(id);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, spr->stride);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, spr->width, spr->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetData());
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		}
+
+		void UpdateTextureRegion(uint32_t id, olc::Sprite* spr, const olc::vi2d& pos, const olc::vi2d& size) override
+		{
+			UNUSED(id);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, spr->stride);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, pos.x, pos.y, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetRow(pos.y) + pos.x);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 		}
 
 		void ReadTexture(uint32_t id, olc::Sprite* spr) override
 		{
+			glPixelStorei(GL_PACK_ROW_LENGTH, spr->stride);
 			glReadPixels(0, 0, spr->width, spr->height, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetData());
+			glPixelStorei(GL_PACK_ROW_LENGTH, 0);
 		}
 
 		void ApplyTexture(uint32_t id) override
@@ -4211,12 +5038,49 @@ namespace olc
 		void UpdateTexture(uint32_t id, olc::Sprite* spr) override
 		{
 			UNUSED(id);
+#if defined(OLC_PLATFORM_EMSCRIPTEN)
+			// GLES2 can't skip the padding at the end of each row, so padded sprites go up a row at a time
+			if (spr->stride != spr->width)
+			{
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, spr->width, spr->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+				for (int32_t y = 0; y < spr->height; y++)
+					glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, spr->width, 1, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetRow(y));
+				return;
+			}
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, spr->width, spr->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetData());
+#else
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, spr->stride);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, spr->width, spr->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetData());
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+		}
+
+		void UpdateTextureRegion(uint32_t id, olc::Sprite* spr, const olc::vi2d& pos, const olc::vi2d& size) override
+		{
+			UNUSED(id);
+#if defined(OLC_PLATFORM_EMSCRIPTEN)
+			// GLES2 can't skip pixels between rows, so upload whole rows instead
+			if (spr->stride == spr->width)
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, pos.y, spr->width, size.y, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetRow(pos.y));
+			else
+				for (int32_t y = pos.y; y < pos.y + size.y; y++)
+					glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, spr->width, 1, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetRow(y));
+#else
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, spr->stride);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, pos.x, pos.y, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetRow(pos.y) + pos.x);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
 		}
 
 		void ReadTexture(uint32_t id, olc::Sprite* spr) override
 		{
+#if !defined(OLC_PLATFORM_EMSCRIPTEN)
+			glPixelStorei(GL_PACK_ROW_LENGTH, spr->stride);
+#endif
 			glReadPixels(0, 0, spr->width, spr->height, GL_RGBA, GL_UNSIGNED_BYTE, spr->GetData());
+#if !defined(OLC_PLATFORM_EMSCRIPTEN)
+			glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+#endif
 		}
 
 		void ApplyTexture(uint32_t id) override
@@ -4243,6 +5107,364 @@ namespace olc
 // O------------------------------------------------------------------------------O
 #pragma endregion
 
+#pragma region renderer_software
+// O------------------------------------------------------------------------------O
+// | START RENDERER: Software (no GPU, no display - frames stay in memory)        |
+// O------------------------------------------------------------------------------O
+#if defined(OLC_GFX_SOFTWARE)
+namespace olc
+{
+	class Renderer_Software : public olc::Renderer
+	{
+	private:
+		// Textures are just copies of the sprites uploaded to them
+		struct Texture
+		{
+			int32_t width = 0;
+			int32_t height = 0;
+			bool bFiltered = false;
+			bool bClamp = true;
+			std::vector<olc::Pixel> vData;
+		};
+
+		// Colours are blended as normalised floats, like the GPU would
+		struct Colour { float r, g, b, a; };
+
+		std::map<uint32_t, Texture> mapTextures;
+		uint32_t nNextTexture = 1;
+		const Texture* pBoundTexture = nullptr;
+		olc::DecalMode nDecalMode = olc::DecalMode::NORMAL;
+		olc::Sprite sprFrame;
+		std::vector<int32_t> vColumns;
+
+	public:
+		void PrepareDevice() override
+		{}
+
+		olc::rcode CreateDevice(std::vector<void*> params, bool bFullScreen, bool bVSYNC) override
+		{
+			UNUSED(params); UNUSED(bFullScreen); UNUSED(bVSYNC);
+			return olc::rcode::OK;
+		}
+
+		olc::rcode DestroyDevice() override
+		{
+			mapTextures.clear();
+			pBoundTexture = nullptr;
+			return olc::rcode::OK;
+		}
+
+		void DisplayFrame() override
+		{
+			// There's nowhere to show it, so hand it to whoever wants it
+			ptrPGE->olc_CaptureFrame(sprFrame);
+		}
+
+		void PrepareDrawing() override
+		{
+			nDecalMode = olc::DecalMode::NORMAL;
+		}
+
+		void SetDecalMode(const olc::DecalMode& mode) override
+		{
+			nDecalMode = mode;
+		}
+
+		void DrawLayerQuad(const olc::vf2d& offset, const olc::vf2d& scale, const olc::Pixel tint) override
+		{
+			const Colour cTint = ToColour(tint);
+			const float fInvW = 1.0f / float(sprFrame.width), fInvH = 1.0f / float(sprFrame.height);
+			const Texture* pTexture = pBoundTexture;
+
+			// Layers are usually unfiltered, so every row reads the same texel columns
+			if (pTexture != nullptr && !pTexture->vData.empty() && !pTexture->bFiltered)
+			{
+				vColumns.resize(sprFrame.width);
+				for (int32_t x = 0; x < sprFrame.width; x++)
+					vColumns[x] = Wrap(int32_t(std::floor(((float(x) + 0.5f) * fInvW * scale.x + offset.x) * float(pTexture->width))), pTexture->width, pTexture->bClamp);
+
+				// Untinted, opaque texels can be copied straight into the frame
+				const bool bCopyOpaque = tint == olc::WHITE && nDecalMode == olc::DecalMode::NORMAL;
+				for (int32_t y = 0; y < sprFrame.height; y++)
+				{
+					const float v = (float(y) + 0.5f) * fInvH * scale.y + offset.y;
+					const olc::Pixel* pRow = pTexture->vData.data() + Wrap(int32_t(std::floor(v * float(pTexture->height))), pTexture->height, pTexture->bClamp) * pTexture->width;
+					olc::Pixel* pDest = sprFrame.GetRow(y);
+					for (int32_t x = 0; x < sprFrame.width; x++)
+					{
+						const olc::Pixel& texel = pRow[vColumns[x]];
+						if (bCopyOpaque && texel.a == 255) pDest[x] = texel;
+						else Blend(pDest[x], Modulate(ToColour(texel), cTint));
+					}
+				}
+				return;
+			}
+
+			for (int32_t y = 0; y < sprFrame.height; y++)
+			{
+				const float v = (float(y) + 0.5f) * fInvH * scale.y + offset.y;
+				olc::Pixel* pDest = sprFrame.GetRow(y);
+				for (int32_t x = 0; x < sprFrame.width; x++)
+				{
+					const float u = (float(x) + 0.5f) * fInvW * scale.x + offset.x;
+					Blend(pDest[x], Modulate(Sample(pTexture, u, v), cTint));
+				}
+			}
+		}
+
+		void DrawDecal(const olc::DecalInstance& decal) override
+		{
+			SetDecalMode(decal.mode);
+			auto it = decal.decal == nullptr ? mapTextures.end() : mapTextures.find(uint32_t(decal.decal->id));
+			const Texture* pTexture = it == mapTextures.end() ? nullptr : &it->second;
+
+			if (nDecalMode == olc::DecalMode::WIREFRAME)
+			{
+				for (uint32_t n = 0; n < decal.points; n++)
+					RasteriseLine(decal, pTexture, n, (n + 1) % decal.points);
+				return;
+			}
+
+			// Break the decal down into triangles (lines aren't drawn, as in OpenGL 1.0)
+			if (decal.structure == olc::DecalStructure::FAN)
+				for (uint32_t n = 2; n < decal.points; n++) RasteriseTriangle(decal, pTexture, 0, n - 1, n);
+			else if (decal.structure == olc::DecalStructure::STRIP)
+				for (uint32_t n = 2; n < decal.points; n++) RasteriseTriangle(decal, pTexture, n - 2, n - 1, n);
+			else if (decal.structure == olc::DecalStructure::LIST)
+				for (uint32_t n = 2; n < decal.points; n += 3) RasteriseTriangle(decal, pTexture, n - 2, n - 1, n);
+		}
+
+		uint32_t CreateTexture(const uint32_t width, const uint32_t height, const bool filtered, const bool clamp) override
+		{
+			uint32_t id = nNextTexture++;
+			Texture& texture = mapTextures[id];
+			texture.width = int32_t(width);
+			texture.height = int32_t(height);
+			texture.bFiltered = filtered;
+			texture.bClamp = clamp;
+			texture.vData.resize(size_t(width) * size_t(height));
+			return id;
+		}
+
+		uint32_t DeleteTexture(const uint32_t id) override
+		{
+			auto it = mapTextures.find(id);
+			if (it != mapTextures.end())
+			{
+				if (pBoundTexture == &it->second) pBoundTexture = nullptr;
+				mapTextures.erase(it);
+			}
+			return id;
+		}
+
+		void UpdateTexture(uint32_t id, olc::Sprite* spr) override
+		{
+			auto it = mapTextures.find(id);
+			if (it == mapTextures.end()) return;
+			Texture& texture = it->second;
+			texture.width = spr->width;
+			texture.height = spr->height;
+			texture.vData.resize(size_t(spr->width) * size_t(spr->height));
+			for (int32_t y = 0; y < spr->height; y++)
+				std::copy_n(spr->GetRow(y), spr->width, texture.vData.data() + size_t(y) * spr->width);
+		}
+
+		void UpdateTextureRegion(uint32_t id, olc::Sprite* spr, const olc::vi2d& pos, const olc::vi2d& size) override
+		{
+			auto it = mapTextures.find(id);
+			if (it == mapTextures.end()) return;
+			Texture& texture = it->second;
+			if (texture.width != spr->width || texture.height != spr->height) { UpdateTexture(id, spr); return; }
+			for (int32_t y = pos.y; y < pos.y + size.y; y++)
+				std::copy_n(spr->GetRow(y) + pos.x, size.x, texture.vData.data() + y * texture.width + pos.x);
+		}
+
+		void ReadTexture(uint32_t id, olc::Sprite* spr) override
+		{
+			// Like glReadPixels, anything that isn't a texture reads back the frame itself
+			const olc::Pixel* pSource = sprFrame.GetData();
+			int32_t nWidth = sprFrame.width, nHeight = sprFrame.height;
+			auto it = mapTextures.find(id);
+			if (it != mapTextures.end())
+			{
+				pSource = it->second.vData.data();
+				nWidth = it->second.width;
+				nHeight = it->second.height;
+			}
+			for (int32_t y = 0; y < std::min(nHeight, spr->height); y++)
+				std::copy_n(pSource + y * nWidth, std::min(nWidth, spr->width), spr->GetRow(y));
+		}
+
+		void ApplyTexture(uint32_t id) override
+		{
+			auto it = mapTextures.find(id);
+			pBoundTexture = it == mapTextures.end() ? nullptr : &it->second;
+		}
+
+		void ClearBuffer(olc::Pixel p, bool bDepth) override
+		{
+			UNUSED(bDepth);
+			std::fill(sprFrame.pColData.begin(), sprFrame.pColData.end(), p);
+		}
+
+		void UpdateViewport(const olc::vi2d& pos, const olc::vi2d& size) override
+		{
+			// With no window around it, the frame is just the viewport
+			UNUSED(pos);
+			if (size.x == sprFrame.width && size.y == sprFrame.height) return;
+			sprFrame.width = std::max(size.x, 1);
+			sprFrame.height = std::max(size.y, 1);
+			sprFrame.stride = sprFrame.width;
+			sprFrame.pColData.assign(size_t(sprFrame.width) * size_t(sprFrame.height), olc::BLACK);
+		}
+
+	private:
+		static Colour ToColour(const olc::Pixel& p)
+		{ return { float(p.r) / 255.0f, float(p.g) / 255.0f, float(p.b) / 255.0f, float(p.a) / 255.0f }; }
+
+		static Colour Modulate(const Colour& a, const Colour& b)
+		{ return { a.r * b.r, a.g * b.g, a.b * b.b, a.a * b.a }; }
+
+		// Bring a texel coordinate back inside a texture, by clamping or repeating
+		static int32_t Wrap(int32_t i, int32_t nSize, bool bClamp)
+		{ return bClamp ? std::clamp(i, 0, nSize - 1) : ((i % nSize) + nSize) % nSize; }
+
+		static const olc::Pixel& Texel(const Texture& texture, int32_t x, int32_t y)
+		{ return texture.vData[Wrap(y, texture.height, texture.bClamp) * texture.width + Wrap(x, texture.width, texture.bClamp)]; }
+
+		// Sample a texture at normalised coordinates (white without one, like an unbound texture)
+		static Colour Sample(const Texture* pTexture, float u, float v)
+		{
+			if (pTexture == nullptr || pTexture->vData.empty()) return { 1.0f, 1.0f, 1.0f, 1.0f };
+			const float x = u * float(pTexture->width), y = v * float(pTexture->height);
+			if (!pTexture->bFiltered)
+				return ToColour(Texel(*pTexture, int32_t(std::floor(x)), int32_t(std::floor(y))));
+
+			// Bilinear filtering, between the four nearest texel centres
+			const float fx = x - 0.5f, fy = y - 0.5f;
+			const int32_t x0 = int32_t(std::floor(fx)), y0 = int32_t(std::floor(fy));
+			const float tx = fx - float(x0), ty = fy - float(y0);
+			const Colour c00 = ToColour(Texel(*pTexture, x0, y0)), c10 = ToColour(Texel(*pTexture, x0 + 1, y0));
+			const Colour c01 = ToColour(Texel(*pTexture, x0, y0 + 1)), c11 = ToColour(Texel(*pTexture, x0 + 1, y0 + 1));
+			auto mix = [&](float a, float b, float c, float d)
+			{ return (a * (1.0f - tx) + b * tx) * (1.0f - ty) + (c * (1.0f - tx) + d * tx) * ty; };
+			return { mix(c00.r, c10.r, c01.r, c11.r), mix(c00.g, c10.g, c01.g, c11.g), mix(c00.b, c10.b, c01.b, c11.b), mix(c00.a, c10.a, c01.a, c11.a) };
+		}
+
+		// Blend a colour into the frame, with the same factors as the OpenGL renderers
+		void Blend(olc::Pixel& dest, const Colour& src) const
+		{
+			const Colour dst = ToColour(dest);
+			Colour out;
+			auto apply = [&](float fSrc, float fDst)
+			{
+				out = { src.r * fSrc + dst.r * fDst, src.g * fSrc + dst.g * fDst, src.b * fSrc + dst.b * fDst, src.a * fSrc + dst.a * fDst };
+			};
+			switch (nDecalMode)
+			{
+			case olc::DecalMode::ADDITIVE:   apply(src.a, 1.0f); break;
+			case olc::DecalMode::STENCIL:    apply(0.0f, src.a); break;
+			case olc::DecalMode::ILLUMINATE: apply(1.0f - src.a, src.a); break;
+			case olc::DecalMode::MULTIPLICATIVE:
+				out = { src.r * dst.r + dst.r * (1.0f - src.a), src.g * dst.g + dst.g * (1.0f - src.a),
+					src.b * dst.b + dst.b * (1.0f - src.a), src.a * dst.a + dst.a * (1.0f - src.a) };
+				break;
+			default:                         apply(src.a, 1.0f - src.a); break;
+			}
+			auto quantise = [](float f) { return uint8_t(std::clamp(f, 0.0f, 1.0f) * 255.0f + 0.5f); };
+			dest = olc::Pixel(quantise(out.r), quantise(out.g), quantise(out.b), quantise(out.a));
+		}
+
+		// Decal positions are in normalised device coordinates (-1 to 1, y up)
+		olc::vf2d ToFrame(const olc::vf2d& pos) const
+		{ return { (pos.x + 1.0f) * 0.5f * float(sprFrame.width), (1.0f - pos.y) * 0.5f * float(sprFrame.height) }; }
+
+		// Shade a point on a decal from the weights of its vertices. Texture coordinates
+		// are divided by w afterwards, for warped decals (like glTexCoord4f)
+		Colour Shade(const olc::DecalInstance& decal, const Texture* pTexture, const uint32_t* pIndex, const float* pWeight, uint32_t nCount) const
+		{
+			float u = 0.0f, v = 0.0f, w = 0.0f;
+			Colour tint = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (uint32_t i = 0; i < nCount; i++)
+			{
+				const uint32_t n = pIndex[i];
+				u += decal.uv[n].x * pWeight[i]; v += decal.uv[n].y * pWeight[i]; w += decal.w[n] * pWeight[i];
+				const Colour c = ToColour(decal.tint[n]);
+				tint = { tint.r + c.r * pWeight[i], tint.g + c.g * pWeight[i], tint.b + c.b * pWeight[i], tint.a + c.a * pWeight[i] };
+			}
+			if (w != 0.0f) { u /= w; v /= w; }
+			return Modulate(Sample(pTexture, u, v), tint);
+		}
+
+		void RasteriseTriangle(const olc::DecalInstance& decal, const Texture* pTexture, uint32_t i0, uint32_t i1, uint32_t i2)
+		{
+			uint32_t index[3] = { i0, i1, i2 };
+			olc::vf2d p[3] = { ToFrame(decal.pos[i0]), ToFrame(decal.pos[i1]), ToFrame(decal.pos[i2]) };
+			auto edge = [](const olc::vf2d& a, const olc::vf2d& b, float x, float y) { return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x); };
+
+			// Wind every triangle the same way, so the inside is always positive
+			float fArea = edge(p[0], p[1], p[2].x, p[2].y);
+			if (fArea == 0.0f) return;
+			if (fArea < 0.0f) { std::swap(p[1], p[2]); std::swap(index[1], index[2]); fArea = -fArea; }
+
+			// Pixels exactly on an edge belong to the triangle on its top or left, so fans
+			// and strips don't blend their shared edges twice
+			bool bTopLeft[3];
+			for (int e = 0; e < 3; e++)
+			{
+				const olc::vf2d d = p[(e + 2) % 3] - p[(e + 1) % 3];
+				bTopLeft[e] = (d.y == 0.0f && d.x > 0.0f) || d.y < 0.0f;
+			}
+
+			const int32_t x0 = std::max(int32_t(std::floor(std::min({ p[0].x, p[1].x, p[2].x }))), 0);
+			const int32_t x1 = std::min(int32_t(std::ceil(std::max({ p[0].x, p[1].x, p[2].x }))), sprFrame.width - 1);
+			const int32_t y0 = std::max(int32_t(std::floor(std::min({ p[0].y, p[1].y, p[2].y }))), 0);
+			const int32_t y1 = std::min(int32_t(std::ceil(std::max({ p[0].y, p[1].y, p[2].y }))), sprFrame.height - 1);
+
+			for (int32_t y = y0; y <= y1; y++)
+			{
+				olc::Pixel* pDest = sprFrame.GetRow(y);
+				for (int32_t x = x0; x <= x1; x++)
+				{
+					const float cx = float(x) + 0.5f, cy = float(y) + 0.5f;
+					float weight[3];
+					bool bInside = true;
+					for (int e = 0; e < 3 && bInside; e++)
+					{
+						// Each vertex is weighted by the edge opposite it
+						const float f = edge(p[(e + 1) % 3], p[(e + 2) % 3], cx, cy);
+						bInside = f > 0.0f || (f == 0.0f && bTopLeft[e]);
+						weight[e] = f / fArea;
+					}
+					if (bInside) Blend(pDest[x], Shade(decal, pTexture, index, weight, 3));
+				}
+			}
+		}
+
+		void RasteriseLine(const olc::DecalInstance& decal, const Texture* pTexture, uint32_t i0, uint32_t i1)
+		{
+			const olc::vf2d a = ToFrame(decal.pos[i0]), b = ToFrame(decal.pos[i1]);
+			const int32_t nSteps = std::max(int32_t(std::ceil(std::max(std::abs(b.x - a.x), std::abs(b.y - a.y)))), 1);
+			const uint32_t index[2] = { i0, i1 };
+			// The last pixel is left for the next line of the loop
+			for (int32_t i = 0; i < nSteps; i++)
+			{
+				const float t = float(i) / float(nSteps);
+				const olc::vf2d p = a + (b - a) * t;
+				const int32_t x = int32_t(std::floor(p.x)), y = int32_t(std::floor(p.y));
+				if (x < 0 || y < 0 || x >= sprFrame.width || y >= sprFrame.height) continue;
+				const float weight[2] = { 1.0f - t, t };
+				Blend(sprFrame.GetRow(y)[x], Shade(decal, pTexture, index, weight, 2));
+			}
+		}
+	};
+}
+#endif
+// O------------------------------------------------------------------------------O
+// | END RENDERER: Software (no GPU, no display - frames stay in memory)          |
+// O------------------------------------------------------------------------------O
+#pragma endregion
+
 // O------------------------------------------------------------------------------O
 // | olcPixelGameEngine Image loaders                                             |
 // O------------------------------------------------------------------------------O
@@ -4328,7 +5550,7 @@ namespace olc
 			{
 				// Load sprite from input stream
 				ResourceBuffer rb = pack->GetFileBuffer(sImageFile);
-				bmp = Gdiplus::Bitmap::FromStream(SHCreateMemStream((BYTE*)rb.vMemory.data(), UINT(rb.vMemory.size())));
+				bmp = Gdiplus::Bitmap::FromStream(SHCreateMemStream((BYTE*)rb.Data(), UINT(rb.Size())));
 			}
 			else
 			{
@@ -4342,6 +5564,7 @@ namespace olc
 			if (bmp->GetLastStatus() != Gdiplus::Ok) return olc::rcode::FAIL;
 			spr->width = bmp->GetWidth();
 			spr->height = bmp->GetHeight();
+			spr->stride = spr->width;
 
 			spr->pColData.resize(spr->width * spr->height);
 
@@ -4411,6 +5634,7 @@ namespace olc
 				png_bytep* row_pointers;
 				spr->width = png_get_image_width(png, info);
 				spr->height = png_get_image_height(png, info);
+				spr->stride = spr->width;
 				color_type = png_get_color_type(png, info);
 				bit_depth = png_get_bit_depth(png, info);
 				if (bit_depth == 16) png_set_strip_16(png);
@@ -4422,27 +5646,14 @@ namespace olc
 				if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
 					png_set_gray_to_rgb(png);
 				png_read_update_info(png, info);
-				row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * spr->height);
-				for (int y = 0; y < spr->height; y++) {
-					row_pointers[y] = (png_byte*)malloc(png_get_rowbytes(png, info));
-				}
-				png_read_image(png, row_pointers);
 				////////////////////////////////////////////////////////////////////////////
-				// Create sprite array
+				// Create sprite array - every row is now RGBA, which is exactly how an
+				// olc::Pixel is laid out, so libpng can decode straight into the sprite
 				spr->pColData.resize(spr->width * spr->height);
-				// Iterate through image rows, converting into sprite format
+				row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * spr->height);
 				for (int y = 0; y < spr->height; y++)
-				{
-					png_bytep row = row_pointers[y];
-					for (int x = 0; x < spr->width; x++)
-					{
-						png_bytep px = &(row[x * 4]);
-						spr->SetPixel(x, y, Pixel(px[0], px[1], px[2], px[3]));
-					}
-				}
-
-				for (int y = 0; y < spr->height; y++) // Thanks maksym33
-					free(row_pointers[y]);
+					row_pointers[y] = (png_bytep)spr->GetRow(y);
+				png_read_image(png, row_pointers);
 				free(row_pointers);
 				png_destroy_read_struct(&png, &info, nullptr);
 			};
@@ -4476,6 +5687,7 @@ namespace olc
 		fail_load:
 			spr->width = 0;
 			spr->height = 0;
+			spr->stride = 0;
 			spr->pColData.clear();
 			return olc::rcode::FAIL;
 		}
@@ -4526,7 +5738,7 @@ namespace olc
 			if (pack != nullptr)
 			{
 				ResourceBuffer rb = pack->GetFileBuffer(sImageFile);
-				bytes = stbi_load_from_memory((unsigned char*)rb.vMemory.data(), rb.vMemory.size(), &w, &h, &cmp, 4);
+				bytes = stbi_load_from_memory((unsigned char*)rb.Data(), int(rb.Size()), &w, &h, &cmp, 4);
 			}
 			else
 			{
@@ -4536,10 +5748,10 @@ namespace olc
 			}
 
 			if (!bytes) return olc::rcode::FAIL;
-			spr->width = w; spr->height = h;
+			spr->width = w; spr->height = h; spr->stride = w;
 			spr->pColData.resize(spr->width * spr->height);
 			std::memcpy(spr->pColData.data(), bytes, spr->width * spr->height * 4);
-			delete[] bytes;
+			stbi_image_free(bytes);
 			return olc::rcode::OK;
 		}
 
@@ -5768,6 +6980,81 @@ extern "C"
 // O------------------------------------------------------------------------------O
 #pragma endregion
 
+#pragma region platform_headless
+// O------------------------------------------------------------------------------O
+// | START PLATFORM: Headless (no window, no input - for servers and containers)  |
+// O------------------------------------------------------------------------------O
+#if defined(OLC_PLATFORM_HEADLESS)
+namespace olc
+{
+	class Platform_Headless : public olc::Platform
+	{
+	public:
+		virtual olc::rcode ApplicationStartUp() override
+		{
+			return olc::rcode::OK;
+		}
+
+		virtual olc::rcode ApplicationCleanUp() override
+		{
+			return olc::rcode::OK;
+		}
+
+		virtual olc::rcode ThreadStartUp() override
+		{
+			return olc::rcode::OK;
+		}
+
+		virtual olc::rcode ThreadCleanUp() override
+		{
+			renderer->DestroyDevice();
+			return olc::OK;
+		}
+
+		virtual olc::rcode CreateGraphics(bool bFullScreen, bool bEnableVSYNC, const olc::vi2d& vViewPos, const olc::vi2d& vViewSize) override
+		{
+			if (renderer->CreateDevice({}, bFullScreen, bEnableVSYNC) == olc::rcode::OK)
+			{
+				renderer->UpdateViewport(vViewPos, vViewSize);
+				return olc::rcode::OK;
+			}
+			else
+				return olc::rcode::FAIL;
+		}
+
+		virtual olc::rcode CreateWindowPane(const olc::vi2d& vWindowPos, olc::vi2d& vWindowSize, bool bFullScreen) override
+		{
+			// There's no window, but we act as if we had focus - input can still be
+			// injected through the olc_Update*() functions
+			UNUSED(vWindowPos); UNUSED(vWindowSize); UNUSED(bFullScreen);
+			ptrPGE->olc_UpdateKeyFocus(true);
+			ptrPGE->olc_UpdateMouseFocus(true);
+			return olc::OK;
+		}
+
+		virtual olc::rcode SetWindowTitle(const std::string& s) override
+		{
+			UNUSED(s);
+			return olc::OK;
+		}
+
+		virtual olc::rcode StartSystemEventLoop() override
+		{
+			return olc::OK;
+		}
+
+		virtual olc::rcode HandleSystemEvent() override
+		{
+			return olc::OK;
+		}
+	};
+}
+#endif
+// O------------------------------------------------------------------------------O
+// | END PLATFORM: Headless                                                       |
+// O------------------------------------------------------------------------------O
+#pragma endregion
+
 
 #endif // Headless
 
@@ -5817,6 +7104,10 @@ namespace olc
 		platform = std::make_unique<olc::Platform_Emscripten>();
 #endif
 
+#if defined(OLC_PLATFORM_HEADLESS)
+		platform = std::make_unique<olc::Platform_Headless>();
+#endif
+
 #if defined(OLC_PLATFORM_CUSTOM_EX)
 		platform = std::make_unique<OLC_PLATFORM_CUSTOM_EX>();
 #endif
@@ -5843,6 +7134,10 @@ namespace olc
 		renderer = std::make_unique<olc::Renderer_DX11>();
 #endif
 
+#if defined(OLC_GFX_SOFTWARE)
+		renderer = std::make_unique<olc::Renderer_Software>();
+#endif
+
 #if defined(OLC_GFX_CUSTOM_EX)
 		renderer = std::make_unique<OLC_RENDERER_CUSTOM_EX>();
 #endif